@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "Parsec/Parsec.hpp"
+#include "RomanNumeralsParser.hpp"
+
+namespace CalcParser {
+
+    enum class TokenKind : std::uint8_t {
+        Numeral, Plus, Minus, Mlt, Div, LeftBracket, RightBracket, Invalid
+    };
+
+    struct Token {
+        TokenKind kind;
+        std::uint32_t offset; // position of the token in the source line
+        std::int64_t value;   // value of a numeral
+    };
+
+    using TokenSpan = std::span<const Token>;
+
+    namespace Internal::Lexer {
+
+        inline bool is_roman(char c) {
+            switch (c) {
+                case 'M': case 'D': case 'C': case 'L':
+                case 'X': case 'V': case 'I': case 'Z':
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // end of the run of characters starting at pos which satisfy is_space / is_roman,
+        // 16 characters are classified at once when SSE2 is available
+        template<bool Roman>
+        std::size_t run_end(std::string_view str, std::size_t pos) {
+#if defined(__SSE2__)
+            for (; pos + 16 <= str.size(); pos += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos));
+                __m128i in_class;
+                if constexpr (Roman) {
+                    in_class = _mm_setzero_si128();
+                    for (char c : {'M', 'D', 'C', 'L', 'X', 'V', 'I', 'Z'}) {
+                        in_class = _mm_or_si128(in_class, _mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+                    }
+                } else {
+                    in_class = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+                                            _mm_cmpeq_epi8(block, _mm_set1_epi8('\t')));
+                }
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(in_class));
+                if (mask != 0xFFFF) {
+                    return pos + __builtin_ctz(~mask);
+                }
+            }
+#endif
+            while (pos < str.size() && (Roman ? is_roman(str[pos]) : Parsec::Internal::is_space(str[pos]))) {
+                ++pos;
+            }
+            return pos;
+        }
+
+        inline TokenKind operator_kind(char c) {
+            switch (c) {
+                case '+': return TokenKind::Plus;
+                case '-': return TokenKind::Minus;
+                case '*': return TokenKind::Mlt;
+                case '/': return TokenKind::Div;
+                case '(': return TokenKind::LeftBracket;
+                case ')': return TokenKind::RightBracket;
+                default:  return TokenKind::Invalid;
+            }
+        }
+
+    } // namespace Internal::Lexer
+
+    // Splits a line into tokens, spaces are dropped. A run of roman letters becomes one
+    // or more numerals exactly as roman_numeral() would read them one after another.
+    // Lexing stops after the first Invalid token, since nothing after it can be parsed.
+    inline std::vector<Token> tokenize(std::string_view str) {
+        using namespace Internal::Lexer;
+        static const Parsec::Grammar<std::int64_t> numeral(Internal::RomanNumerals::roman_numeral);
+
+        std::vector<Token> tokens;
+        std::size_t pos = run_end<false>(str, 0);
+        while (pos < str.size()) {
+            if (is_roman(str[pos])) {
+                std::size_t end = run_end<true>(str, pos);
+                std::string_view run = str.substr(pos, end - pos);
+                while (!run.empty()) {
+                    auto offset = static_cast<std::uint32_t>(end - run.size());
+                    auto result = numeral.parse(run);
+                    if (!result) {
+                        tokens.push_back({TokenKind::Invalid, offset, 0});
+                        return tokens;
+                    }
+                    tokens.push_back({TokenKind::Numeral, offset, result.value()});
+                    run = result.rest();
+                }
+                pos = end;
+            } else {
+                TokenKind kind = operator_kind(str[pos]);
+                tokens.push_back({kind, static_cast<std::uint32_t>(pos), 0});
+                if (kind == TokenKind::Invalid) {
+                    break;
+                }
+                ++pos;
+            }
+            pos = run_end<false>(str, pos);
+        }
+        return tokens;
+    }
+
+} // namespace CalcParser
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "CalcParser.hpp"
+#include "CalcParallel.hpp"
+
+namespace CalcParser {
+
+    // settings of the command line tool, see main.cpp
+    struct LineOptions {
+        Operands operands = Operands::Roman;
+        std::size_t max_depth = std::numeric_limits<std::size_t>::max();
+        std::uint64_t max_steps = std::numeric_limits<std::uint64_t>::max();
+        std::optional<std::chrono::milliseconds> timeout;
+        unsigned threads = std::thread::hardware_concurrency(); // for one long line
+    };
+
+    // value of a numeric command line option: the whole text must be a number in the range of T
+    template<typename T>
+    std::optional<T> option_number(std::string_view text) {
+        T value{};
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    // Everything the tool does with one input line: the prefilter, the parse under a budget
+    // and the text of the answer. Shared by the stdin mode and the socket server, evaluate()
+    // may be called from any number of threads.
+    class LineCalc {
+    public:
+        explicit LineCalc(const LineOptions& options_ = {})
+            : options(options_), parser(options.threads, 1 << 16, options.operands, options.max_depth),
+              grammar(options.operands == Operands::Roman ? roman_calc : mixed_calc),
+              prefilter(grammar.parser()) {}
+
+        // the answer to line, a single line ending with '\n'
+        std::string evaluate(std::string_view line) const {
+            // lines with foreign chars or unbalanced brackets fail, but where and how (an overflow
+            // may come first) only the parser tells; it just does not split them between threads
+            bool rejected = prefilter.reject(line).has_value();
+            try {
+                Parsec::Budget budget(options.max_steps, options.timeout
+                        ? std::optional(Parsec::Budget::Clock::now() + *options.timeout) : std::nullopt);
+                auto result = rejected ? parser.parse_sequential(line, budget) : parser.parse(line, budget);
+                if (result && result.rest().empty()) {
+                    return arabic_numeral_to_roman(result.value()).str();
+                } else if (result) {
+                    return "error: Parsing failed. Part from position " + std::to_string(line.size() - result.rest().size() + 1) + " not parsed.\n";
+                } else {
+                    return "error: Parsing failed. Message: " + result.get_message() + '\n';
+                }
+            } catch (const std::overflow_error&) {
+                return "error: Overflow int64 error.\n";
+            } catch (const Parsec::BudgetExceeded& e) {
+                aborted_count.fetch_add(1, std::memory_order_relaxed);
+                return std::string("error: ") + e.what() + ".\n";
+            }
+        }
+
+        // lines which ran out of the budget so far
+        std::size_t aborted() const {
+            return aborted_count.load(std::memory_order_relaxed);
+        }
+
+        void save_profile(std::ostream& out) const {
+            parser.save_profile(out);
+        }
+
+        void load_profile(std::istream& in) const {
+            parser.load_profile(in);
+        }
+
+    private:
+        LineOptions options;
+        ParallelCalc parser;
+        Parsec::Grammar<int64_t> grammar;
+        Parsec::Prefilter prefilter;
+        mutable std::atomic<std::size_t> aborted_count = 0;
+    };
+
+} // namespace CalcParser
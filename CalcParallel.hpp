@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "CalcParser.hpp"
+#include "CalcStack.hpp"
+
+namespace CalcParser {
+
+    namespace Internal::Parallel {
+
+        // previous not space char is the end of an operand (roman or arabic), so '+' / '-' at pos is binary
+        inline bool is_binary(std::string_view str, std::size_t pos) {
+            while (pos > 0 && Parsec::Internal::is_space(str[pos - 1])) {
+                --pos;
+            }
+            char prev = pos > 0 ? str[pos - 1] : '\0';
+            return prev == ')' || Lexer::is_roman(prev) || (prev >= '0' && prev <= '9');
+        }
+
+        // Positions of the binary '+' and '-' outside of any brackets. Brackets are counted
+        // 16 chars at a time: blocks without brackets inside brackets are skipped at once.
+        // Returns false if brackets are unbalanced, then the line is not split.
+        inline bool top_level_operators(std::string_view str, std::vector<std::size_t>& ops) {
+            std::int64_t depth = 0;
+            auto visit = [&](std::size_t pos) {
+                char c = str[pos];
+                if (c == '(') {
+                    ++depth;
+                } else if (c == ')') {
+                    --depth;
+                } else if ((c == '+' || c == '-') && depth == 0 && is_binary(str, pos)) {
+                    ops.push_back(pos);
+                }
+                return depth >= 0;
+            };
+            std::size_t pos = 0;
+#if defined(__SSE2__)
+            for (; pos + 16 <= str.size(); pos += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + pos));
+                unsigned brackets = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(
+                        _mm_cmpeq_epi8(block, _mm_set1_epi8('(')), _mm_cmpeq_epi8(block, _mm_set1_epi8(')')))));
+                if (depth > 0 && brackets == 0) {
+                    continue;
+                }
+                unsigned signs = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(
+                        _mm_cmpeq_epi8(block, _mm_set1_epi8('+')), _mm_cmpeq_epi8(block, _mm_set1_epi8('-')))));
+                for (unsigned mask = brackets | signs; mask != 0; mask &= mask - 1) {
+                    if (!visit(pos + __builtin_ctz(mask))) {
+                        return false;
+                    }
+                }
+            }
+#endif
+            for (; pos < str.size(); ++pos) {
+                if (!visit(pos)) {
+                    return false;
+                }
+            }
+            return depth == 0;
+        }
+
+        // Whether the recursive grammar nests at most MaxNesting calls deep on str, counting
+        // every open bracket and unary minus, with at most max_brackets brackets open at once.
+        // The parser stops at a ')' without a pair, so the scan does too.
+        template<std::size_t MaxNesting>
+        bool shallow(std::string_view str, std::size_t max_brackets) {
+            // unary minuses before an open bracket stay on the native stack until its ')'
+            std::array<std::size_t, MaxNesting> minuses{};
+            std::size_t brackets = 0;
+            std::size_t nesting = 0;
+            std::size_t pending = 0;
+            for (std::size_t pos = 0; pos < str.size(); ++pos) {
+                char c = str[pos];
+                if (Parsec::Internal::is_space(c)) {
+                    continue;
+                }
+                if (c == '-' && !is_binary(str, pos)) {
+                    ++pending;
+                } else if (c == '(') {
+                    if (nesting + pending + 1 > MaxNesting || brackets == max_brackets) {
+                        return false;
+                    }
+                    minuses[brackets++] = pending;
+                    nesting += pending + 1;
+                    pending = 0;
+                } else if (c == ')') {
+                    if (brackets == 0) {
+                        return true;
+                    }
+                    nesting -= minuses[--brackets] + 1;
+                    pending = 0;
+                } else {
+                    pending = 0;
+                }
+                if (nesting + pending > MaxNesting) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // values of consecutive terms parsed by one worker, stops at the first term that
+        // does not parse completely or throws
+        struct Chunk {
+            std::vector<std::int64_t> values;
+            bool failed = false;
+            std::exception_ptr error;
+        };
+
+    } // namespace Internal::Parallel
+
+    // Evaluates a single very long expression on several threads. The top level chain of
+    // '+' / '-' is split at operator boundaries, terms are parsed concurrently with
+    // roman_mlt_div and then combined left to right with the usual overflow checks.
+    // Lines which can not be split exactly (unbalanced brackets, a term that does not parse)
+    // are parsed sequentially, so the result is always the one of roman_calc() / mixed_calc().
+    // Lines nested at most max_recursive_depth deep are parsed by the recursive grammar, deeper
+    // ones, which could overflow the thread stack, and the terms of split lines are evaluated
+    // by StackCalc.
+    // A budget limits the whole sequential parse and every worker separately.
+    class ParallelCalc {
+    public:
+        // open brackets and unary minuses nested on the native stack; unoptimised builds take
+        // about 2 KB of it for a bracket, so this stays far below the smallest thread stacks
+        static constexpr std::size_t max_recursive_depth = 128;
+
+        explicit ParallelCalc(unsigned threads_ = std::thread::hardware_concurrency(),
+                              std::size_t min_parallel_size_ = 1 << 16,
+                              Operands operands = Operands::Roman,
+                              std::size_t max_depth_ = std::numeric_limits<std::size_t>::max())
+            : calc(operands == Operands::Roman ? roman_calc : mixed_calc),
+              stack(max_depth_, operands),
+              threads(std::max(threads_, 1u)), min_parallel_size(min_parallel_size_),
+              max_depth(max_depth_) {}
+
+        Parsec::Internal::Result<int64_t> parse(std::string_view line) const {
+            if (threads == 1 || line.size() < min_parallel_size) {
+                return parse_sequential(line);
+            }
+            std::vector<std::size_t> ops;
+            if (!Internal::Parallel::top_level_operators(line, ops) || ops.size() < threads) {
+                return stack.parse(line);
+            }
+
+            // term i is [starts[i], ends[i]), its trailing spaces are eaten by the term itself
+            std::vector<std::size_t> starts = {line.size() - Parsec::Internal::skip_spaces(line).size()};
+            std::vector<std::size_t> ends;
+            for (std::size_t op : ops) {
+                ends.push_back(op);
+                starts.push_back(line.size() - Parsec::Internal::skip_spaces(line.substr(op + 1)).size());
+            }
+            ends.push_back(line.size());
+
+            // workers charge copies of the budget of this thread
+            const Parsec::Budget* budget = Parsec::Internal::active_budget();
+            std::vector<std::future<Internal::Parallel::Chunk>> chunks;
+            std::size_t first = 0;
+            for (unsigned t = 0; t < threads; ++t) {
+                std::size_t last = first;
+                std::size_t bound = line.size() / threads * (t + 1);
+                while (last < starts.size() && (starts[last] < bound || t + 1 == threads)) {
+                    ++last;
+                }
+                chunks.push_back(std::async(std::launch::async, [this, line, &starts, &ends, first, last, budget] {
+                    if (!budget) {
+                        return parse_terms(line, starts, ends, first, last);
+                    }
+                    Parsec::Budget copy = *budget;
+                    Parsec::Internal::BudgetScope scope(copy);
+                    return parse_terms(line, starts, ends, first, last);
+                }));
+                first = last;
+            }
+
+            // a term that throws or does not parse stops the sequential parser before any '+' / '-'
+            // is applied, so the terms are combined only when all of them are parsed
+            std::vector<int64_t> values;
+            values.reserve(starts.size());
+            for (auto& future : chunks) {
+                Internal::Parallel::Chunk chunk = future.get();
+                values.insert(values.end(), chunk.values.begin(), chunk.values.end());
+                if (chunk.error) {
+                    std::rethrow_exception(chunk.error);
+                }
+                if (chunk.failed) {
+                    return stack.parse(line);
+                }
+            }
+            int64_t value = values[0];
+            for (std::size_t i = 1; i < values.size(); ++i) {
+                value = line[ops[i - 1]] == '+' ? Internal::plus(value, values[i])
+                                                : Internal::minus(value, values[i]);
+            }
+            return Parsec::Internal::Result<int64_t>{value, line.substr(line.size())};
+        }
+
+        // throws Parsec::BudgetExceeded when the budget runs out
+        Parsec::Internal::Result<int64_t> parse(std::string_view line, Parsec::Budget& budget) const {
+            Parsec::Internal::BudgetScope scope(budget);
+            return parse(line);
+        }
+
+        // as parse, on the calling thread only: for lines known to fail, whose split would be undone
+        Parsec::Internal::Result<int64_t> parse_sequential(std::string_view line) const {
+            // StackCalc reports brackets nested deeper than max_depth, the grammar does not
+            return Internal::Parallel::shallow<max_recursive_depth>(line, max_depth) ? calc.parse(line)
+                                                                                     : stack.parse(line);
+        }
+
+        Parsec::Internal::Result<int64_t> parse_sequential(std::string_view line, Parsec::Budget& budget) const {
+            Parsec::Internal::BudgetScope scope(budget);
+            return parse_sequential(line);
+        }
+
+        // learned order of alternatives, see Parsec::Grammar::save_profile
+        void save_profile(std::ostream& out) const {
+            calc.save_profile(out);
+        }
+
+        void load_profile(std::istream& in) const {
+            calc.load_profile(in);
+        }
+
+    private:
+        Internal::Parallel::Chunk parse_terms(std::string_view line,
+                                              const std::vector<std::size_t>& starts,
+                                              const std::vector<std::size_t>& ends,
+                                              std::size_t first, std::size_t last) const {
+            Internal::Parallel::Chunk chunk;
+            chunk.values.reserve(last - first);
+            for (std::size_t i = first; i < last; ++i) {
+                try {
+                    auto result = stack.parse_term(line.substr(starts[i], ends[i] - starts[i]));
+                    if (!result || !result.rest().empty()) {
+                        chunk.failed = true;
+                        break;
+                    }
+                    chunk.values.push_back(result.value());
+                } catch (...) {
+                    chunk.error = std::current_exception();
+                    break;
+                }
+            }
+            return chunk;
+        }
+
+        Parsec::Grammar<int64_t> calc;
+        StackCalc stack;
+        unsigned threads;
+        std::size_t min_parallel_size;
+        std::size_t max_depth;
+    };
+
+} // namespace CalcParser
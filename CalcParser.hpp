@@ -4,14 +4,14 @@
 #include <limits>
 #include <stdexcept>
 
-inline void check_mlt_overflow(std::int64_t a, std::int64_t b) {
+constexpr void check_mlt_overflow(std::int64_t a, std::int64_t b) {
     if (b != 0 && (a > std::numeric_limits<std::int64_t>::max() / b
                ||  a < std::numeric_limits<std::int64_t>::min() / b)) {
         throw std::overflow_error("");
     }
 }
 
-inline void check_div_overflow(std::int64_t a, std::int64_t b) {
+constexpr void check_div_overflow(std::int64_t a, std::int64_t b) {
     if (b == 0) {
         throw std::overflow_error("");
     }
@@ -20,14 +20,14 @@ inline void check_div_overflow(std::int64_t a, std::int64_t b) {
     }
 }
 
-inline void check_plus_overflow(std::int64_t a, std::int64_t b) {
+constexpr void check_plus_overflow(std::int64_t a, std::int64_t b) {
     if ((b > 0 && a > std::numeric_limits<std::int64_t>::max() - b)
       || (b < 0 && a < std::numeric_limits<std::int64_t>::min() - b)) {
         throw std::overflow_error("");
     }
 }
 
-inline void check_minus_overflow(std::int64_t a, std::int64_t b) {
+constexpr void check_minus_overflow(std::int64_t a, std::int64_t b) {
     if ((b < 0 && a > std::numeric_limits<std::int64_t>::max() + b)
       || (b > 0 && a < std::numeric_limits<std::int64_t>::min() + b)) {
         throw std::overflow_error("");
@@ -36,82 +36,215 @@ inline void check_minus_overflow(std::int64_t a, std::int64_t b) {
 
 #include "Parsec/Parsec.hpp"
 #include "RomanNumeralsParser.hpp"
+#include "CalcLexer.hpp"
 
 namespace CalcParser {
 
+    // numerals accepted as operands
+    enum class Operands {
+        Roman, RomanAndArabic
+    };
+
     namespace Internal {
 
         using namespace Parsec;
 
+        template<Operands O = Operands::Roman>
         Parser<int64_t> roman_expr();
+        template<Operands O = Operands::Roman>
         Parser<int64_t> roman_atom();
 
-        Parser<int64_t> roman_numeral() {
+        inline Parser<int64_t> roman_numeral() {
             return RomanNumerals::roman_numeral();
         }
 
+        template<Operands O = Operands::Roman>
         Parser<int64_t> roman_unary_minus_atom() {
-            return map_parser(char_parser('-') >> lazy_parser<int64_t>(roman_atom), [](int64_t a) { return -a; });
+            return map_parser(token('-') >> lazy_parser<int64_t>(roman_atom<O>), [](int64_t a) { return -a; });
         }
 
+        template<Operands O = Operands::Roman>
         Parser<int64_t> roman_brackets() {
-            // На самом деле, исходя из грамматики, здесь должен быть только один второй случай,
-            // Но если сделать так, то слишком просто построить пример, на котором парсер работает медленно
-            // А так начинают быстрее работать всякие ((((((I)))))) и похожие примеры
-            return brackets_parser(char_parser('('), lazy_parser<int64_t>(roman_brackets), char_parser(')'))
-                 | brackets_parser(char_parser('('), lazy_parser<int64_t>(roman_expr), char_parser(')'));
+            // Раньше здесь была ещё альтернатива "(" brackets ")" перед "(" expr ")", чтобы быстрее работали ((((((I)))))),
+            // пока lazy_parser пересобирал граф на каждом вызове. Теперь правила строятся один раз,
+            // а после "(" бэктрекинг не нужен: ошибка внутри скобок окончательна
+            return brackets_parser(token('('), lazy_parser<int64_t>(roman_expr<O>), token(')'));
+        }
+
+        // знак у арабского числа не читается, минус разбирает roman_unary_minus_atom
+        inline Parser<int64_t> arabic_numeral() {
+            return unsigned_integer<int64_t>();
         }
 
+        template<Operands O>
         Parser<int64_t> roman_atom() {
-            return roman_numeral() | roman_unary_minus_atom() | roman_brackets();
+            // ветки начинаются с разных символов, поэтому первой пробуется самая частая
+            if constexpr (O == Operands::RomanAndArabic) {
+                return adaptive_alternative<int64_t>("roman_arabic_atom", {
+                    lexeme(roman_numeral()), lexeme(arabic_numeral()), roman_unary_minus_atom<O>(), roman_brackets<O>()
+                });
+            } else {
+                return adaptive_alternative<int64_t>("roman_atom", {
+                    lexeme(roman_numeral()), roman_unary_minus_atom<O>(), roman_brackets<O>()
+                });
+            }
+        }
+
+        constexpr int64_t mlt(int64_t a, int64_t b) {
+            check_mlt_overflow(a, b);
+            return a * b;
+        }
+
+        constexpr int64_t div(int64_t a, int64_t b) {
+            check_div_overflow(a, b);
+            return a / b - (((a < 0) ^ (b < 0)) && (a % b != 0));
+            // -5/-2 = 2, -5/2 = -3, 5/-2 = -3, 5/2 = 2 НО! 2/-2 = -1
+        }
+
+        constexpr int64_t plus(int64_t a, int64_t b) {
+            check_plus_overflow(a, b);
+            return a + b;
         }
 
+        constexpr int64_t minus(int64_t a, int64_t b) {
+            check_minus_overflow(a, b);
+            return a - b;
+        }
+
+        template<Operands O = Operands::Roman>
         Parser<int64_t> roman_mlt_div() {
-            return fold(
-                seq_save(roman_atom(), char_parser('*') | char_parser('/')),
-                {
-                        {'*', [](int64_t a, int64_t b) { 
-                            check_mlt_overflow(a, b); 
-                            return a * b; 
-                        }},
-
-                        {'/', [](int64_t a, int64_t b) { 
-                            check_div_overflow(a, b);
-                            return a / b - (((a < 0) ^ (b < 0)) && (a % b != 0)); 
-                        }} 
-                        // -5/-2 = 2, -5/2 = -3, 5/-2 = -3, 5/2 = 2 НО! 2/-2 = -1
-                }
+            return chain_left(
+                lazy_parser<int64_t>(roman_atom<O>), token('*') | token('/'),
+                {{'*', mlt}, {'/', div}}
             );
         }
 
+        template<Operands O>
         Parser<int64_t> roman_expr() {
-            return fold(
-                seq_save(roman_mlt_div(), char_parser('+') | char_parser('-')),
-                {
-                        {'+', [](int64_t a, int64_t b) { check_plus_overflow(a, b); return a + b; }},
-                        {'-', [](int64_t a, int64_t b) { check_minus_overflow(a, b); return a - b; }}
-                }
+            return chain_left(
+                roman_mlt_div<O>(), token('+') | token('-'),
+                {{'+', plus}, {'-', minus}}
             );
         }
 
+        // the same grammar over the output of tokenize()
+        namespace Tokens {
+
+            Parser<int64_t, TokenSpan> token_expr();
+            Parser<int64_t, TokenSpan> token_atom();
+
+            inline Parser<TokenKind, TokenSpan> kind(TokenKind k) {
+                return fmap_parser<Token, TokenKind>(
+                        satisfy<TokenSpan>([k](const Token& t) { return t.kind == k; }),
+                        [](const Token& t) { return t.kind; });
+            }
+
+            inline Parser<int64_t, TokenSpan> token_numeral() {
+                return fmap_parser<Token, int64_t>(
+                        satisfy<TokenSpan>([](const Token& t) { return t.kind == TokenKind::Numeral; }),
+                        [](const Token& t) { return t.value; });
+            }
+
+            inline Parser<int64_t, TokenSpan> token_unary_minus_atom() {
+                return map_parser(kind(TokenKind::Minus) >> lazy_parser(token_atom), [](int64_t a) { return -a; });
+            }
+
+            inline Parser<int64_t, TokenSpan> token_brackets() {
+                return brackets_parser(kind(TokenKind::LeftBracket), lazy_parser(token_expr), kind(TokenKind::RightBracket));
+            }
+
+            inline Parser<int64_t, TokenSpan> token_atom() {
+                return token_numeral() | token_unary_minus_atom() | token_brackets();
+            }
+
+            inline Parser<int64_t, TokenSpan> token_mlt_div() {
+                return chain_left(
+                    token_atom(), kind(TokenKind::Mlt) | kind(TokenKind::Div),
+                    {{TokenKind::Mlt, mlt}, {TokenKind::Div, div}}
+                );
+            }
+
+            inline Parser<int64_t, TokenSpan> token_expr() {
+                return chain_left(
+                    token_mlt_div(), kind(TokenKind::Plus) | kind(TokenKind::Minus),
+                    {{TokenKind::Plus, plus}, {TokenKind::Minus, minus}}
+                );
+            }
+
+        } // namespace Tokens
+
     } // namespace Internal
 
-    Parsec::Parser<int64_t> roman_calc() {
-        return Internal::roman_expr();
+    // compile-time twin of roman_calc(), see Parsec/ParsecStatic.hpp
+    namespace Static {
+
+        using namespace Parsec::Static;
+
+        constexpr Result<int64_t> roman_expr(std::string_view str);
+        constexpr Result<int64_t> roman_atom(std::string_view str);
+
+        constexpr Result<int64_t> roman_unary_minus_atom(std::string_view str) {
+            return map_parser(token('-') >> rule<roman_atom>(), [](int64_t a) { return -a; }).parse(str);
+        }
+
+        constexpr Result<int64_t> roman_brackets(std::string_view str) {
+            return brackets_parser(token('('), rule<roman_expr>(), token(')')).parse(str);
+        }
+
+        constexpr Result<int64_t> roman_atom(std::string_view str) {
+            return (lexeme(rule<RomanNumerals::roman_numeral>()) | rule<roman_unary_minus_atom>() | rule<roman_brackets>()).parse(str);
+        }
+
+        constexpr Result<int64_t> roman_mlt_div(std::string_view str) {
+            return chain_left(rule<roman_atom>(), token('*') | token('/'), [](int64_t a, char op, int64_t b) {
+                return op == '*' ? Internal::mlt(a, b) : Internal::div(a, b);
+            }).parse(str);
+        }
+
+        constexpr Result<int64_t> roman_expr(std::string_view str) {
+            return chain_left(rule<roman_mlt_div>(), token('+') | token('-'), [](int64_t a, char op, int64_t b) {
+                return op == '+' ? Internal::plus(a, b) : Internal::minus(a, b);
+            }).parse(str);
+        }
+
+        constexpr Result<int64_t> roman_calc(std::string_view str) {
+            return (spaces() >> rule<roman_expr>()).parse(str);
+        }
+
+    } // namespace Static
+
+    // value of a constant expression computed by the compiler,
+    // ill-formed if the expression does not parse completely or overflows
+    consteval int64_t roman_calc_value(std::string_view expr) {
+        auto result = Static::roman_calc(expr);
+        if (!result || !result.rest.empty()) {
+            throw std::invalid_argument("not a roman expression");
+        }
+        return result.value;
     }
 
-    std::stringstream arabic_numeral_to_roman(int64_t x) {
-        return Internal::RomanNumerals::print_arabic_numeral_to_roman(x);
+    // spaces are allowed between tokens, so lines are parsed as they are
+    inline Parsec::Parser<int64_t> roman_calc() {
+        return Parsec::spaces() >> Internal::roman_expr();
     }
 
-    std::string remove_all_spaces(const std::string& str) {
-        std::string new_str;
-        for (char c : str) {
-            if (c != ' ' && c != '\t') {
-                new_str.push_back(c);
-            }
-        }
-        return new_str;
+    // roman_calc() which also accepts arabic operands, like "XII * 3 - (IV + 10)"
+    inline Parsec::Parser<int64_t> mixed_calc() {
+        return Parsec::spaces() >> Internal::roman_expr<Operands::RomanAndArabic>();
+    }
+
+    // roman_calc() over tokenize(line); rest() of the result is a suffix of the tokens
+    inline Parsec::Parser<int64_t, TokenSpan> roman_calc_tokens() {
+        return Internal::Tokens::token_expr();
+    }
+
+    // position in the source line of the first token of rest
+    inline std::size_t token_position(std::string_view line, TokenSpan rest) {
+        return rest.empty() ? line.size() : rest.front().offset;
+    }
+
+    inline std::stringstream arabic_numeral_to_roman(int64_t x) {
+        return Internal::RomanNumerals::print_arabic_numeral_to_roman(x);
     }
 
 } // namespace CalcParser
@@ -0,0 +1,535 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CalcLine.hpp"
+
+namespace CalcParser {
+
+    namespace Internal::Serve {
+
+        [[noreturn]] inline void fail(const char* what) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        inline sockaddr_un address(const std::string& path) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path)) {
+                throw std::invalid_argument("socket path is too long");
+            }
+            path.copy(addr.sun_path, path.size());
+            return addr;
+        }
+
+        // owns a file descriptor
+        class Fd {
+        public:
+            Fd() = default;
+            explicit Fd(int fd_) : fd(fd_) {}
+            Fd(Fd&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+            Fd& operator=(Fd&& other) noexcept {
+                std::swap(fd, other.fd);
+                return *this;
+            }
+            ~Fd() {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+
+            int get() const { return fd; }
+
+        private:
+            int fd = -1;
+        };
+
+        // the file a listening socket is bound to, removed with the socket
+        struct SocketFile {
+            explicit SocketFile(std::string path_) : path(std::move(path_)) {}
+            SocketFile(const SocketFile&) = delete;
+            SocketFile& operator=(const SocketFile&) = delete;
+            ~SocketFile() {
+                if (bound) {
+                    ::unlink(path.c_str());
+                }
+            }
+
+            std::string path;
+            bool bound = false;
+        };
+
+        // consecutive lines of one connection, evaluated by one worker
+        struct Batch {
+            std::string lines;   // every line ends with '\n'
+            std::string answers;
+            std::atomic<bool> done = false;
+        };
+
+        struct Job {
+            std::uint64_t connection;
+            std::shared_ptr<Batch> batch;
+        };
+
+        struct Connection {
+            explicit Connection(Fd fd_) : fd(std::move(fd_)) {}
+
+            Fd fd;
+            std::string input;                          // the last line, not complete yet
+            std::deque<std::shared_ptr<Batch>> batches; // not sent yet, in the order of the lines
+            std::size_t queued = 0;                     // bytes of the lines of batches
+            std::string output;                         // answers not written yet
+            std::uint32_t interest = EPOLLIN;           // 0: not registered with epoll
+            bool eof = false;
+        };
+
+    } // namespace Internal::Serve
+
+    // Answers lines of any number of clients on a Unix domain socket, the same way the stdin
+    // mode answers lines of stdin, without starting a process and building a grammar per job.
+    // A client may send any number of lines without waiting for the answers: every line gets
+    // exactly one answer line, in the order of the lines of its connection. One thread runs
+    // the epoll loop, complete lines are cut into batches of at most batch_lines and evaluated
+    // by a pool of workers sharing one LineCalc.
+    // A connection is not read while the lines it has queued and its unsent answers take
+    // max_pending bytes or more, so a client which writes without reading is stopped by its
+    // socket instead of growing the server; such a client has to read the answers as it goes.
+    // A connection whose unfinished line grows longer than max_line is closed.
+    // A socket file left at path by an earlier server is replaced; if any other file is there,
+    // the constructor throws std::system_error with EADDRINUSE.
+    // While accept runs out of descriptors, new clients wait in the backlog until a connection
+    // closes or accept_retry passes.
+    class Server {
+    public:
+        static constexpr std::size_t batch_lines = 64;
+        static constexpr std::size_t max_line = std::size_t(1) << 26;
+        static constexpr std::chrono::milliseconds accept_retry{100};
+
+        Server(const LineCalc& calc_, std::string path,
+               unsigned workers_count = std::thread::hardware_concurrency(),
+               std::size_t max_pending_ = std::size_t(1) << 20)
+            : calc(calc_), max_pending(max_pending_), socket_file(std::move(path)) {
+            using namespace Internal::Serve;
+            sockaddr_un addr = address(socket_file.path);
+            listener = Fd(::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+            if (listener.get() < 0) {
+                fail("socket");
+            }
+            // only a socket left by an earlier server is replaced, any other file is kept
+            struct stat existing{};
+            if (::lstat(socket_file.path.c_str(), &existing) == 0) {
+                if (!S_ISSOCK(existing.st_mode)) {
+                    errno = EADDRINUSE;
+                    fail("bind");
+                }
+                ::unlink(socket_file.path.c_str());
+            }
+            if (::bind(listener.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                fail("bind");
+            }
+            socket_file.bound = true;
+            if (::listen(listener.get(), SOMAXCONN) < 0) {
+                fail("listen");
+            }
+            epoll = Fd(::epoll_create1(EPOLL_CLOEXEC));
+            wake = Fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+            if (epoll.get() < 0 || wake.get() < 0) {
+                fail("epoll");
+            }
+            watch(listener.get(), EPOLL_CTL_ADD, EPOLLIN, listener_key);
+            watch(wake.get(), EPOLL_CTL_ADD, EPOLLIN, wake_key);
+            try {
+                for (unsigned i = 0; i < std::max(workers_count, 1u); ++i) {
+                    workers.emplace_back([this] { work(); });
+                }
+            } catch (...) {
+                stop_workers();
+                throw;
+            }
+        }
+
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        ~Server() {
+            stop_workers();
+        }
+
+        // serves until stop()
+        void run() {
+            std::array<epoll_event, 64> events;
+            while (!stopping.load()) {
+                int timeout = accepting ? -1 : static_cast<int>(accept_retry.count());
+                int count = ::epoll_wait(epoll.get(), events.data(), static_cast<int>(events.size()), timeout);
+                if (count < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    Internal::Serve::fail("epoll_wait");
+                }
+                for (int i = 0; i < count; ++i) {
+                    std::uint64_t key = events[i].data.u64;
+                    if (key == listener_key) {
+                        accept_all();
+                    } else if (key == wake_key) {
+                        flush_completed();
+                    } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        receive(key);
+                    } else if (events[i].events & EPOLLOUT) {
+                        flush(key);
+                    }
+                }
+                if (!accepting && std::chrono::steady_clock::now() >= accept_retry_at) {
+                    resume_accepting();
+                }
+            }
+        }
+
+        // makes run() return; may be called from another thread or from a signal handler
+        void stop() {
+            stopping.store(true);
+            std::uint64_t one = 1;
+            [[maybe_unused]] auto written = ::write(wake.get(), &one, sizeof(one));
+        }
+
+    private:
+        static constexpr std::uint64_t listener_key = 0;
+        static constexpr std::uint64_t wake_key = 1;
+
+        void watch(int fd, int op, std::uint32_t events, std::uint64_t key) {
+            epoll_event event{};
+            event.events = events;
+            event.data.u64 = key;
+            if (::epoll_ctl(epoll.get(), op, fd, &event) < 0) {
+                Internal::Serve::fail("epoll_ctl");
+            }
+        }
+
+        void accept_all() {
+            for (;;) {
+                Internal::Serve::Fd fd(::accept4(listener.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+                if (fd.get() < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        // EMFILE, ENFILE, ENOMEM, ...: the listener stays readable, so it would
+                        // wake the loop again at once
+                        pause_accepting();
+                    }
+                    return;
+                }
+                std::uint64_t key = next_key++;
+                watch(fd.get(), EPOLL_CTL_ADD, EPOLLIN, key);
+                connections.emplace(key, Internal::Serve::Connection(std::move(fd)));
+            }
+        }
+
+        void pause_accepting() {
+            ::epoll_ctl(epoll.get(), EPOLL_CTL_DEL, listener.get(), nullptr);
+            accepting = false;
+            accept_retry_at = std::chrono::steady_clock::now() + accept_retry;
+        }
+
+        void resume_accepting() {
+            watch(listener.get(), EPOLL_CTL_ADD, EPOLLIN, listener_key);
+            accepting = true;
+        }
+
+        void receive(std::uint64_t key) {
+            auto it = connections.find(key);
+            if (it == connections.end()) {
+                return;
+            }
+            Internal::Serve::Connection& connection = it->second;
+            char buffer[1 << 16];
+            while (!connection.eof && !throttled(connection)) {
+                ssize_t size = ::read(connection.fd.get(), buffer, sizeof(buffer));
+                if (size > 0) {
+                    connection.input.append(buffer, static_cast<std::size_t>(size));
+                    dispatch(key, connection);
+                    if (connection.input.size() > max_line) {
+                        disconnect(key);
+                        return;
+                    }
+                } else if (size == 0) {
+                    connection.eof = true;
+                    // like std::getline, the last line may end without '\n'
+                    if (!connection.input.empty()) {
+                        connection.input += '\n';
+                        dispatch(key, connection);
+                    }
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                } else {
+                    disconnect(key);
+                    return;
+                }
+            }
+            flush(key);
+        }
+
+        bool throttled(const Internal::Serve::Connection& connection) const {
+            return connection.queued + connection.output.size() >= max_pending;
+        }
+
+        // cuts the complete lines of the input into batches for the workers
+        void dispatch(std::uint64_t key, Internal::Serve::Connection& connection) {
+            std::size_t last = connection.input.rfind('\n');
+            if (last == std::string::npos) {
+                return;
+            }
+            std::size_t begin = 0, lines = 0;
+            std::vector<Internal::Serve::Job> jobs;
+            for (std::size_t pos = connection.input.find('\n'); pos <= last; pos = connection.input.find('\n', pos + 1)) {
+                if (++lines == batch_lines || pos == last) {
+                    auto batch = std::make_shared<Internal::Serve::Batch>();
+                    batch->lines = connection.input.substr(begin, pos + 1 - begin);
+                    connection.queued += batch->lines.size();
+                    connection.batches.push_back(batch);
+                    jobs.push_back({key, std::move(batch)});
+                    begin = pos + 1;
+                    lines = 0;
+                }
+            }
+            connection.input.erase(0, begin);
+            {
+                std::lock_guard lock(jobs_mutex);
+                for (auto& job : jobs) {
+                    pending.push_back(std::move(job));
+                }
+            }
+            jobs_ready.notify_all();
+        }
+
+        void flush_completed() {
+            std::uint64_t count;
+            [[maybe_unused]] auto read = ::read(wake.get(), &count, sizeof(count));
+            std::vector<std::uint64_t> keys;
+            {
+                std::lock_guard lock(completed_mutex);
+                keys.swap(completed);
+            }
+            for (std::uint64_t key : keys) {
+                flush(key);
+            }
+        }
+
+        // writes the answers of the leading finished batches, closes the connection
+        // once the client has sent everything and got every answer
+        void flush(std::uint64_t key) {
+            auto it = connections.find(key);
+            if (it == connections.end()) {
+                return;
+            }
+            Internal::Serve::Connection& connection = it->second;
+            while (!connection.batches.empty() && connection.batches.front()->done.load(std::memory_order_acquire)) {
+                connection.output += connection.batches.front()->answers;
+                connection.queued -= connection.batches.front()->lines.size();
+                connection.batches.pop_front();
+            }
+            std::size_t written = 0;
+            while (written < connection.output.size()) {
+                ssize_t size = ::send(connection.fd.get(), connection.output.data() + written,
+                                      connection.output.size() - written, MSG_NOSIGNAL);
+                if (size >= 0) {
+                    written += static_cast<std::size_t>(size);
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                } else {
+                    disconnect(key);
+                    return;
+                }
+            }
+            connection.output.erase(0, written);
+            if (connection.eof && connection.batches.empty() && connection.output.empty()) {
+                disconnect(key);
+                return;
+            }
+            std::uint32_t interest = (connection.eof || throttled(connection) ? 0u : std::uint32_t(EPOLLIN))
+                                   | (connection.output.empty() ? 0u : std::uint32_t(EPOLLOUT));
+            // epoll reports a hang-up of a registered fd whatever the interest is, so a connection
+            // which waits for its batches only is removed from epoll until they finish, otherwise
+            // the hang-up of its client would wake the loop again and again
+            if (interest != connection.interest) {
+                if (interest == 0) {
+                    ::epoll_ctl(epoll.get(), EPOLL_CTL_DEL, connection.fd.get(), nullptr);
+                } else {
+                    watch(connection.fd.get(), connection.interest == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, interest, key);
+                }
+                connection.interest = interest;
+            }
+        }
+
+        // batches of the connection still being evaluated are dropped when they finish
+        void disconnect(std::uint64_t key) {
+            auto it = connections.find(key);
+            if (it->second.interest != 0) {
+                ::epoll_ctl(epoll.get(), EPOLL_CTL_DEL, it->second.fd.get(), nullptr);
+            }
+            connections.erase(it);
+            // its descriptor may be the one accept was missing
+            if (!accepting) {
+                resume_accepting();
+            }
+        }
+
+        void stop_workers() {
+            {
+                std::lock_guard lock(jobs_mutex);
+                workers_stop = true;
+            }
+            jobs_ready.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            workers.clear();
+        }
+
+        void work() {
+            for (;;) {
+                Internal::Serve::Job job;
+                {
+                    std::unique_lock lock(jobs_mutex);
+                    jobs_ready.wait(lock, [this] { return workers_stop || !pending.empty(); });
+                    if (workers_stop) {
+                        return;
+                    }
+                    job = std::move(pending.front());
+                    pending.pop_front();
+                }
+                Internal::Serve::Batch& batch = *job.batch;
+                std::string_view lines = batch.lines;
+                for (std::size_t end; (end = lines.find('\n')) != std::string_view::npos; lines.remove_prefix(end + 1)) {
+                    batch.answers += calc.evaluate(lines.substr(0, end));
+                }
+                batch.done.store(true, std::memory_order_release);
+                {
+                    std::lock_guard lock(completed_mutex);
+                    completed.push_back(job.connection);
+                }
+                std::uint64_t one = 1;
+                [[maybe_unused]] auto written = ::write(wake.get(), &one, sizeof(one));
+            }
+        }
+
+        const LineCalc& calc;
+        std::size_t max_pending;
+        Internal::Serve::SocketFile socket_file;
+        Internal::Serve::Fd listener;
+        Internal::Serve::Fd epoll;
+        Internal::Serve::Fd wake;
+        std::atomic<bool> stopping = false;
+
+        // owned by the thread of run()
+        std::unordered_map<std::uint64_t, Internal::Serve::Connection> connections;
+        std::uint64_t next_key = wake_key + 1;
+        bool accepting = true; // the listener is registered with epoll
+        std::chrono::steady_clock::time_point accept_retry_at;
+
+        std::mutex jobs_mutex;
+        std::condition_variable jobs_ready;
+        std::deque<Internal::Serve::Job> pending;
+        bool workers_stop = false;
+
+        std::mutex completed_mutex;
+        std::vector<std::uint64_t> completed;
+
+        std::vector<std::thread> workers;
+    };
+
+    // Blocking client of Server, used by the load generator and the tests.
+    class Client {
+    public:
+        explicit Client(const std::string& path)
+            : fd(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+            sockaddr_un addr = Internal::Serve::address(path);
+            if (fd.get() < 0) {
+                Internal::Serve::fail("socket");
+            }
+            if (::connect(fd.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                Internal::Serve::fail("connect");
+            }
+        }
+
+        // lines to evaluate, each one ends with '\n'
+        void send(std::string_view data) {
+            while (!data.empty()) {
+                ssize_t size = ::send(fd.get(), data.data(), data.size(), MSG_NOSIGNAL);
+                if (size < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    Internal::Serve::fail("send");
+                }
+                data.remove_prefix(static_cast<std::size_t>(size));
+            }
+        }
+
+        // no more lines: the server closes the connection after the last answer
+        void finish() {
+            ::shutdown(fd.get(), SHUT_WR);
+        }
+
+        // the next answer without '\n', nothing once the server has closed the connection
+        std::optional<std::string> receive() {
+            std::size_t end;
+            while ((end = buffer.find('\n', scanned)) == std::string::npos) {
+                buffer.erase(0, begin);
+                begin = 0;
+                scanned = buffer.size();
+                char chunk[1 << 16];
+                ssize_t size = ::read(fd.get(), chunk, sizeof(chunk));
+                if (size < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (size <= 0) {
+                    return std::nullopt;
+                }
+                buffer.append(chunk, static_cast<std::size_t>(size));
+            }
+            std::string answer = buffer.substr(begin, end - begin);
+            begin = scanned = end + 1;
+            return answer;
+        }
+
+    private:
+        Internal::Serve::Fd fd;
+        std::string buffer;
+        std::size_t begin = 0;   // the first answer not received yet
+        std::size_t scanned = 0; // buffer before it has no '\n' after begin
+    };
+
+} // namespace CalcParser
+
+#endif // __linux__
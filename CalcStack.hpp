@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "CalcParser.hpp"
+
+namespace CalcParser {
+
+    namespace Internal::Stack {
+
+        // state of one pair of brackets (the line itself is the outermost one)
+        struct Level {
+            int64_t sum = 0;      // value of the '+' / '-' chain before the current term
+            int64_t product = 0;  // value of the '*' / '/' chain before the current atom
+            char sum_op = 0;      // operator before the current term, 0 for the first term
+            char product_op = 0;  // operator before the current atom, 0 for the first atom
+            bool negate = false;  // odd number of unary minuses before the current atom
+        };
+
+        // open brackets; the first levels are kept inline, so that usual lines do not allocate
+        class Levels {
+        public:
+            Level& top() {
+                return count <= near.size() ? near[count - 1] : far[count - 1 - near.size()];
+            }
+
+            void push() {
+                if (count < near.size()) {
+                    near[count] = Level{};
+                } else {
+                    far.emplace_back();
+                }
+                ++count;
+            }
+
+            void pop() {
+                if (count > near.size()) {
+                    far.pop_back();
+                }
+                --count;
+            }
+
+            std::size_t size() const { return count; }
+
+        private:
+            std::array<Level, 16> near;
+            std::vector<Level> far;
+            std::size_t count = 0;
+        };
+
+    } // namespace Internal::Stack
+
+    // Evaluates roman_calc() / mixed_calc() without recursion: open brackets and pending
+    // operators are kept on a heap allocated stack instead of the native one, so nesting
+    // is limited by memory (or by max_depth) and not by the size of the thread stack.
+    // Values, rest, overflow errors and consumed failures are those of the recursive grammar,
+    // messages are those it gives with the default order of alternatives.
+    // Brackets nested deeper than max_depth are a consumed failure.
+    class StackCalc {
+    public:
+        explicit StackCalc(std::size_t max_depth_ = std::numeric_limits<std::size_t>::max(),
+                           Operands operands_ = Operands::Roman)
+            : numeral(Internal::RomanNumerals::roman_numeral), arabic(Internal::arabic_numeral),
+              max_depth(max_depth_), operands(operands_) {}
+
+        // as roman_calc() / mixed_calc()
+        Parsec::Internal::Result<int64_t> parse(std::string_view line) const {
+            return evaluate<false>(line);
+        }
+
+        // every atom is a step of the budget, throws Parsec::BudgetExceeded when it runs out
+        Parsec::Internal::Result<int64_t> parse(std::string_view line, Parsec::Budget& budget) const {
+            Parsec::Internal::BudgetScope scope(budget);
+            return evaluate<false>(line);
+        }
+
+        // as roman_mlt_div(): a chain of '*' / '/' without leading spaces
+        Parsec::Internal::Result<int64_t> parse_term(std::string_view term) const {
+            return evaluate<true>(term);
+        }
+
+    private:
+        template<bool Term>
+        Parsec::Internal::Result<int64_t> evaluate(std::string_view line) const {
+            using Parsec::Internal::nullres;
+            using Parsec::Internal::skip_spaces;
+
+            std::string_view str = Term ? line : skip_spaces(line);
+            // every failure but the one of the very first atom comes after consumed input
+            auto fail = [&](Parsec::Internal::Result<int64_t> failure) {
+                failure.set_consumed(failure.consumed() || str.size() != line.size());
+                return failure;
+            };
+            auto expected = [&](std::string_view what) {
+                return str.empty() ? nullres<int64_t>("Expected ", what, ". But string is empty")
+                                   : nullres<int64_t>("Expected ", what, ". But received ", str.substr(0, 1));
+            };
+
+            Internal::Stack::Levels levels;
+            levels.push();
+            for (;;) {
+                // an atom: unary minuses and open brackets before it only change the stack
+                Parsec::Internal::charge();
+                int64_t value;
+                if (!str.empty() && str[0] == '-') {
+                    levels.top().negate = !levels.top().negate;
+                    str = skip_spaces(str.substr(1));
+                    continue;
+                }
+                if (!str.empty() && str[0] == '(') {
+                    if (levels.size() > max_depth) {
+                        return fail(nullres<int64_t>("Brackets are nested deeper than the limit"));
+                    }
+                    levels.push();
+                    str = skip_spaces(str.substr(1));
+                    continue;
+                }
+                auto number = numeral.parse(str);
+                if (!number && operands == Operands::RomanAndArabic) {
+                    number = arabic.parse(str);
+                    if (!number && number.consumed()) {
+                        return fail(number);
+                    }
+                }
+                if (!number) {
+                    return fail(expected("("));
+                }
+                value = number.value();
+                str = skip_spaces(number.rest());
+
+                // the value completes the atom, then maybe the term, the expression in brackets
+                // and the atom these brackets are, and so on outwards
+                for (;;) {
+                    Internal::Stack::Level& level = levels.top();
+                    if (level.negate) {
+                        value = -value;
+                        level.negate = false;
+                    }
+                    if (level.product_op != 0) {
+                        value = level.product_op == '*' ? Internal::mlt(level.product, value)
+                                                        : Internal::div(level.product, value);
+                        level.product_op = 0;
+                    }
+                    if (!str.empty() && (str[0] == '*' || str[0] == '/')) {
+                        level.product = value;
+                        level.product_op = str[0];
+                        break;
+                    }
+                    if (Term && levels.size() == 1) {
+                        return Parsec::Internal::Result<int64_t>{value, str};
+                    }
+                    if (level.sum_op != 0) {
+                        value = level.sum_op == '+' ? Internal::plus(level.sum, value)
+                                                    : Internal::minus(level.sum, value);
+                        level.sum_op = 0;
+                    }
+                    if (!str.empty() && (str[0] == '+' || str[0] == '-')) {
+                        level.sum = value;
+                        level.sum_op = str[0];
+                        break;
+                    }
+                    if (levels.size() == 1) {
+                        return Parsec::Internal::Result<int64_t>{value, str};
+                    }
+                    if (str.empty() || str[0] != ')') {
+                        return fail(expected(")"));
+                    }
+                    levels.pop();
+                    str = skip_spaces(str.substr(1));
+                }
+                str = skip_spaces(str.substr(1));
+            }
+        }
+
+        Parsec::Grammar<int64_t> numeral;
+        Parsec::Grammar<int64_t> arabic;
+        std::size_t max_depth;
+        Operands operands;
+    };
+
+} // namespace CalcParser
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <optional>
 #include <string>
 #include <iostream>
@@ -7,94 +8,380 @@
 #include <utility>
 #include <vector>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <variant>
+#include <algorithm>
+#include <span>
+#include <string_view>
+#include <bitset>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "ParsecInternal.hpp"
+#include "ParsecStatic.hpp"
 
 namespace Parsec {
 
-    template<typename T>
+    // Non-owning handle to a node; the node lives in the arena it was built in.
+    // In is the input range: std::string_view, std::u8string_view, std::span<const Token>, ...
+    template<typename T, typename In = std::string_view>
     struct Parser {
-        explicit Parser(std::shared_ptr<Internal::IParser<T>> ptr) {
-            parser = ptr;
-        }
+        explicit Parser(Internal::IParser<T, In>* ptr) : parser(ptr) {}
 
-        Internal::Result<T> parse(std::string_view s) {
+        Internal::Result<T, In> parse(In s) const {
             return parser->parse(s);
         }
 
+        // recognise only: the rest and the failure of parse(s) without the value
+        Internal::Skipped<In> skip(In s) const {
+            return parser->skip(s);
+        }
+
+        Internal::IParser<T, In>* node() const { return parser; }
+
     private:
-        std::shared_ptr<Internal::IParser<T>> parser;
+        Internal::IParser<T, In>* parser;
     };
 
     template<typename T, typename R, typename... Args>
-    Parser<T> make_parser(Args&&... args) {
-        return Parser<T>(std::make_shared<R>(std::forward<Args>(args)...));
+    Parser<T, typename R::input_type> make_parser(Args&&... args) {
+        return Parser<T, typename R::input_type>(Internal::Arena::current().make<R>(std::forward<Args>(args)...));
     }
 
-    template<typename T>
-    Parser<T> operator|(Parser<T> alt1, Parser<T> alt2) {
-        return make_parser<T, Internal::IAlternativeParser<T>>(alt1, alt2);
+    // Frozen parser graph built from a root rule. Every node is owned by the grammar
+    // and every rule is resolved in the constructor, so parse() is safe to call concurrently
+    // from any number of threads. The only shared state a parse writes is the success counters
+    // of adaptive alternatives: relaxed atomics, written by about one success in 32.
+    // Parsers obtained from a grammar are valid as long as the grammar is alive.
+    template<typename T, typename In = std::string_view>
+    class Grammar {
+    public:
+        explicit Grammar(Parser<T, In> (*root)())
+            : arena(std::make_unique<Internal::Arena>()), start(arena->rule(root)) {
+            arena->resolve_rules();
+        }
+
+        Internal::Result<T, In> parse(In s) const {
+            return start.parse(s);
+        }
+
+        // parse limited by budget, throws BudgetExceeded when it runs out
+        Internal::Result<T, In> parse(In s, Budget& budget) const {
+            Internal::BudgetScope scope(budget);
+            return start.parse(s);
+        }
+
+        Parser<T, In> parser() const { return start; }
+
+        // number of nodes owned by the grammar
+        std::size_t size() const { return arena->size(); }
+
+        // nodes the builders asked for which were shared with an identical node instead,
+        // size() + reused() is the size the graph would have without hash-consing
+        std::size_t reused() const { return arena->reused(); }
+
+        // learned orders of the adaptive alternatives, one "name i0 i1 ..." line each
+        void save_profile(std::ostream& out) const {
+            for (const Internal::IProfiledNode* node : arena->profiled_nodes()) {
+                out << node->name();
+                for (std::size_t i : node->order()) {
+                    out << ' ' << i;
+                }
+                out << '\n';
+            }
+        }
+
+        // restores orders written by save_profile, lines which do not fit an alternative
+        // of this grammar are skipped; returns the number of restored alternatives
+        std::size_t load_profile(std::istream& in) const {
+            std::size_t restored = 0;
+            std::string line;
+            while (std::getline(in, line)) {
+                std::istringstream fields(line);
+                std::string name;
+                fields >> name;
+                std::vector<std::size_t> order;
+                for (std::size_t i; fields >> i;) {
+                    order.push_back(i);
+                }
+                for (const Internal::IProfiledNode* node : arena->profiled_nodes()) {
+                    if (node->name() == name && node->set_order(order)) {
+                        ++restored;
+                    }
+                }
+            }
+            return restored;
+        }
+
+    private:
+        std::unique_ptr<Internal::Arena> arena;
+        Parser<T, In> start;
+    };
+
+    // Rejects lines which can not be parsed to the end without entering the parser.
+    // The alphabet is collected from the parser graph: a line with a char which no node consumes,
+    // or with unbalanced brackets of brackets_parser, can not be consumed completely.
+    // Graphs with satisfy or other nodes of unknown alphabet accept every line.
+    class Prefilter {
+    public:
+        template<typename T>
+        explicit Prefilter(Parser<T> parser) {
+            Internal::Alphabet alphabet;
+            alphabet.add(parser);
+            any = alphabet.any;
+            allowed = alphabet.chars | alphabet.delimiters;
+            for (auto [open, close] : alphabet.brackets) {
+                // a bracket char which is consumed elsewhere too says nothing about balance
+                auto used = [&](char c) {
+                    auto uc = static_cast<unsigned char>(c);
+                    return alphabet.chars[uc] || alphabet.delimiters[uc] ||
+                           std::count_if(alphabet.brackets.begin(), alphabet.brackets.end(), [c](auto br) {
+                               return br.first == c || br.second == c;
+                           }) != 1;
+                };
+                allowed.set(static_cast<unsigned char>(open));
+                allowed.set(static_cast<unsigned char>(close));
+                if (!used(open) && !used(close) && bracket_count < brackets.size()) {
+                    brackets[bracket_count++] = {open, close};
+                }
+            }
+            for (int c = 0; c < 256; ++c) {
+                if (allowed[c]) {
+                    allowed_list.push_back(static_cast<char>(c));
+                }
+            }
+        }
+
+        // position at which the line is known to fail: a char out of the alphabet, a closing
+        // bracket without a pair or the outermost bracket which is never closed; nullopt if the
+        // line may be parsed. The parser may fail or throw earlier, at a position or for a
+        // reason the prefilter does not see.
+        std::optional<std::size_t> reject(std::string_view line) const {
+            if (any) {
+                return std::nullopt;
+            }
+            std::array<std::int64_t, max_brackets> depth{};
+            std::array<std::size_t, max_brackets> opened{};
+            auto visit = [&](std::size_t pos) {
+                char c = line[pos];
+                if (!allowed[static_cast<unsigned char>(c)]) {
+                    return false;
+                }
+                for (std::size_t i = 0; i < bracket_count; ++i) {
+                    if (c == brackets[i].first && depth[i]++ == 0) {
+                        opened[i] = pos;
+                    } else if (c == brackets[i].second && --depth[i] < 0) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+            std::size_t pos = 0;
+#if defined(__SSE2__)
+            // 16 chars at a time: only chars out of the alphabet and brackets are visited
+            if (allowed_list.size() <= max_simd_chars) {
+                for (; pos + 16 <= line.size(); pos += 16) {
+                    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line.data() + pos));
+                    __m128i in_alphabet = _mm_setzero_si128();
+                    for (char c : allowed_list) {
+                        in_alphabet = _mm_or_si128(in_alphabet, _mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+                    }
+                    __m128i special = _mm_setzero_si128();
+                    for (std::size_t i = 0; i < bracket_count; ++i) {
+                        special = _mm_or_si128(special, _mm_or_si128(
+                                _mm_cmpeq_epi8(block, _mm_set1_epi8(brackets[i].first)),
+                                _mm_cmpeq_epi8(block, _mm_set1_epi8(brackets[i].second))));
+                    }
+                    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special)) |
+                                    (~static_cast<unsigned>(_mm_movemask_epi8(in_alphabet)) & 0xFFFF);
+                    for (; mask != 0; mask &= mask - 1) {
+                        if (!visit(pos + __builtin_ctz(mask))) {
+                            return pos + __builtin_ctz(mask);
+                        }
+                    }
+                }
+            }
+#endif
+            for (; pos < line.size(); ++pos) {
+                if (!visit(pos)) {
+                    return pos;
+                }
+            }
+            std::optional<std::size_t> unclosed;
+            for (std::size_t i = 0; i < bracket_count; ++i) {
+                if (depth[i] > 0 && (!unclosed || opened[i] < *unclosed)) {
+                    unclosed = opened[i];
+                }
+            }
+            return unclosed;
+        }
+
+        // chars which may occur in a parsed line, empty if any char may
+        std::string alphabet() const {
+            return any ? std::string() : std::string(allowed_list.begin(), allowed_list.end());
+        }
+
+        // bracket pairs checked for balance
+        std::vector<std::pair<char, char>> checked_brackets() const {
+            return {brackets.begin(), brackets.begin() + bracket_count};
+        }
+
+    private:
+        static constexpr std::size_t max_brackets = 4;
+        static constexpr std::size_t max_simd_chars = 32;
+
+        bool any = false;
+        std::bitset<256> allowed;
+        std::vector<char> allowed_list;
+        std::array<std::pair<char, char>, max_brackets> brackets{};
+        std::size_t bracket_count = 0;
+    };
+
+    // alt2 is tried only if alt1 failed without consuming input, wrap alt1 in try_ to backtrack further
+    template<typename T, typename In>
+    Parser<T, In> operator|(Parser<T, In> alt1, Parser<T, In> alt2) {
+        return make_parser<T, Internal::IAlternativeParser<T, In>>(alt1, alt2);
     }
 
-    template<typename U, typename T>
-    Parser<T> operator>>(Parser<U> skip_parser, Parser<T> parser) {
-        return make_parser<T, Internal::ISkipParser<U, T>>(skip_parser, parser);
+    template<typename U, typename T, typename In>
+    Parser<T, In> operator>>(Parser<U, In> skip_parser, Parser<T, In> parser) {
+        return make_parser<T, Internal::ISkipParser<U, T, In>>(skip_parser, parser);
     }
 
-    Parser<char> char_parser(char c) {
-        return make_parser<char, Internal::ICharParser>(c);
+    inline Parser<char> char_parser(char c) {
+        return make_parser<char, Internal::ICharParser<std::string_view>>(c);
     }
 
-    Parser<char> chars_alt_parser(std::vector<char> chars) {
-        return make_parser<char, Internal::ICharsParser>(std::move(chars));
+    inline Parser<char> chars_alt_parser(std::vector<char> chars) {
+        return make_parser<char, Internal::ICharsParser<std::string_view>>(std::move(chars));
     }
 
-    Parser<std::string_view> prefix_parser(std::string_view str) {
-        return make_parser<std::string_view, Internal::IPrefixParser>(str);
+    inline Parser<std::string_view> prefix_parser(std::string_view str) {
+        return make_parser<std::string_view, Internal::IPrefixParser<std::string_view>>(str);
     }
 
-    template<typename T>
-    Parser<T> id_parser(T id_value) {
-        return make_parser<T, Internal::IIdParser<T>>(std::move(id_value));
+    // char_parser, chars_alt_parser and prefix_parser for any input range
+    template<typename In>
+    Parser<Internal::Elem<In>, In> elem_parser(Internal::Elem<In> e) {
+        return make_parser<Internal::Elem<In>, Internal::ICharParser<In>>(std::move(e));
     }
 
-    template<typename T, typename U, typename R, typename Func>
-    Parser<R> merge_parser(Parser<T> p1, Parser<U> p2, Func f) {
-        return make_parser<R, Internal::IMergeParser<T, U, R, Func>>(std::move(p1), std::move(p2), std::move(f));
+    template<typename In>
+    Parser<Internal::Elem<In>, In> elems_alt_parser(std::vector<Internal::Elem<In>> elems) {
+        return make_parser<Internal::Elem<In>, Internal::ICharsParser<In>>(std::move(elems));
     }
 
-    template<typename T>
-    Parser<T> if_equal_not_parsed(Parser<T> parser, T ban_value) {
-        return make_parser<T, Internal::IBanParser<T>>(std::move(parser), std::move(ban_value));
+    template<typename In>
+        requires (!std::is_convertible_v<In, std::string_view>)
+    Parser<In, In> prefix_parser(In target) {
+        return make_parser<In, Internal::IPrefixParser<In>>(target);
+    }
+
+    // one element for which pred(elem) is true
+    template<typename In, typename Pred>
+    Parser<Internal::Elem<In>, In> satisfy(Pred pred) {
+        return make_parser<Internal::Elem<In>, Internal::ISatisfyParser<In, Pred>>(std::move(pred));
+    }
+
+    template<typename T, typename In = std::string_view>
+    Parser<T, In> id_parser(T id_value) {
+        return make_parser<T, Internal::IIdParser<T, In>>(std::move(id_value));
+    }
+
+    template<typename T, typename U, typename R, typename Func, typename In>
+    Parser<R, In> merge_parser(Parser<T, In> p1, Parser<U, In> p2, Func f) {
+        return make_parser<R, Internal::IMergeParser<T, U, R, Func, In>>(std::move(p1), std::move(p2), std::move(f));
+    }
+
+    template<typename T, typename In>
+    Parser<T, In> if_equal_not_parsed(Parser<T, In> parser, T ban_value) {
+        return make_parser<T, Internal::IBanParser<T, In>>(std::move(parser), std::move(ban_value));
     }
 
     // if string is empty return default_value
-    template<typename T>
-    Parser<T> empty_parser(T default_value) {
-        return make_parser<T, Internal::IEmptyParser<T>>(std::move(default_value));
+    template<typename T, typename In = std::string_view>
+    Parser<T, In> empty_parser(T default_value) {
+        return make_parser<T, Internal::IEmptyParser<T, In>>(std::move(default_value));
     }
 
     // if string is empty return nullres even if parse is success
-    template<typename T>
-    Parser<T> not_empty_str(Parser<T> parser) {
-        return make_parser<T, Internal::INotEmptyParser<T>>(std::move(parser));
+    template<typename T, typename In>
+    Parser<T, In> not_empty_str(Parser<T, In> parser) {
+        return make_parser<T, Internal::INotEmptyParser<T, In>>(std::move(parser));
     }
 
-    template<typename T>
-    Parser<std::vector<T>> many(Parser<T> parser) {
-        return make_parser<std::vector<T>, Internal::IManyParser<T>>(std::move(parser));
+    template<typename T, typename In>
+    Parser<std::vector<T>, In> many(Parser<T, In> parser) {
+        return make_parser<std::vector<T>, Internal::IManyParser<T, In>>(std::move(parser));
+    }
+
+    // many without building a vector: number of occurrences
+    template<typename T, typename In>
+    Parser<std::size_t, In> count_many(Parser<T, In> parser) {
+        return make_parser<std::size_t, Internal::ICountManyParser<T, In>>(std::move(parser));
+    }
+
+    // many without building a vector: results are dropped
+    template<typename T, typename In>
+    Parser<std::monostate, In> skip_many(Parser<T, In> parser) {
+        return make_parser<std::monostate, Internal::ISkipManyParser<T, In>>(std::move(parser));
+    }
+
+    // many without building a vector: acc = f(acc, value) for every occurrence, starting from init
+    template<typename T, typename R, typename Func, typename In>
+    Parser<R, In> fold_many(Parser<T, In> parser, R init, Func f) {
+        return make_parser<R, Internal::IFoldManyParser<T, R, Func, In>>(std::move(parser), std::move(init), std::move(f));
+    }
+
+    // consumed part of the input instead of the value of parser
+    template<typename T, typename In>
+    Parser<In, In> capture(Parser<T, In> parser) {
+        return make_parser<In, Internal::ICaptureParser<T, In>>(std::move(parser));
     }
 
-    Parser<char> space() {
+    inline Parser<char> space() {
         //TODO: maybe more special symbols
         return chars_alt_parser({' ', '\t'});
     }
 
-    Parser<char> spaces() {
-        return make_parser<char, Internal::IManyIgnoreParser<char>>(space());
+    inline Parser<char> spaces() {
+        return make_parser<char, Internal::ISpacesParser<std::string_view>>();
     }
 
-    Parser<char> alpha() {
+    // spaces() for any text input, e.g. std::u8string_view or std::u32string_view
+    template<typename In>
+    Parser<Internal::Elem<In>, In> spaces() {
+        return make_parser<Internal::Elem<In>, Internal::ISpacesParser<In>>();
+    }
+
+    // parser followed by any number of spaces, the spaces are skipped
+    template<typename T, typename In>
+    Parser<T, In> lexeme(Parser<T, In> parser) {
+        return make_parser<T, Internal::ILexemeParser<T, In>>(std::move(parser));
+    }
+
+    inline Parser<char> token(char c) {
+        return lexeme(char_parser(c));
+    }
+
+    inline Parser<std::string_view> token(std::string_view str) {
+        return lexeme(prefix_parser(str));
+    }
+
+    inline Parser<char> alpha() {
         std::vector<char> alpha;
         for (char c = 'a'; c <= 'z'; ++c) {
             alpha.push_back(c);
@@ -102,7 +389,7 @@ namespace Parsec {
         return chars_alt_parser(alpha);
     }
 
-    Parser<char> maybe_num() {
+    inline Parser<char> maybe_num() {
         std::vector<char> digits;
         for (char c = '0'; c <= '9'; ++c) {
             digits.push_back(c);
@@ -110,49 +397,129 @@ namespace Parsec {
         return chars_alt_parser(digits);
     }
 
-    Parser<char> alpha_num() {
+    // decimal integer with an optional '-' for signed T, overflow of T is a parse failure
+    template<typename T>
+    requires std::is_integral_v<T>
+    Parser<T> integer() {
+        return make_parser<T, Internal::INumberParser<T, std::is_signed_v<T>>>();
+    }
+
+    // decimal integer without a sign, T may still be signed
+    template<typename T>
+    requires std::is_integral_v<T>
+    Parser<T> unsigned_integer() {
+        return make_parser<T, Internal::INumberParser<T, false>>();
+    }
+
+    // decimal number with an optional '-', fraction and exponent, like 12, -0.5, 1e-3 or .25
+    template<typename T>
+    requires std::is_floating_point_v<T>
+    Parser<T> floating() {
+        return make_parser<T, Internal::INumberParser<T, true>>();
+    }
+
+    inline Parser<char> alpha_num() {
         return alpha() | maybe_num();
     }
 
-    template<typename T, typename Func>
-    Parser<T> map_parser(Parser<T> parser, Func f) {
-        return make_parser<T, Internal::IFMapParser<T, T, Func>>(std::move(parser), std::move(f));
+    template<typename T, typename Func, typename In>
+    Parser<T, In> map_parser(Parser<T, In> parser, Func f) {
+        return make_parser<T, Internal::IFMapParser<T, T, Func, In>>(std::move(parser), std::move(f));
     }
 
-    template<typename T, typename R, typename Func>
-    Parser<R> fmap_parser(Parser<T> parser, Func f) {
-        return make_parser<R, Internal::IFMapParser<T, R, Func>>(std::move(parser), std::move(f));
+    template<typename T, typename R, typename Func, typename In>
+    Parser<R, In> fmap_parser(Parser<T, In> parser, Func f) {
+        return make_parser<R, Internal::IFMapParser<T, R, Func, In>>(std::move(parser), std::move(f));
     }
 
-    template<typename T>
-    Parser<T> maybe_parser(Parser<T> parser, T default_value) {
-        return make_parser<T, Internal::IMaybeParser<T>>(std::move(parser), std::move(default_value));
+    template<typename T, typename In>
+    Parser<T, In> maybe_parser(Parser<T, In> parser, T default_value) {
+        return make_parser<T, Internal::IMaybeParser<T, In>>(std::move(parser), std::move(default_value));
     }
 
-    template<typename T, typename U>
-    Parser<std::vector<T>> seq(Parser<T> elem_parser, Parser<U> sep_parser) {
-        return make_parser<std::vector<T>, Internal::ISeqParser<T, U>>
+    template<typename T, typename U, typename In>
+    Parser<std::vector<T>, In> seq(Parser<T, In> elem_parser, Parser<U, In> sep_parser) {
+        return make_parser<std::vector<T>, Internal::ISeqParser<T, U, In>>
                 (std::move(elem_parser), std::move(sep_parser));
     }
 
-    template<typename T, typename U>
-    Parser<Internal::SeqWithSeps<T, U>> seq_save(Parser<T> elem_parser, Parser<U> sep_parser) {
-        return make_parser<Internal::SeqWithSeps<T, U>, Internal::ISeqSaverParser<T, U>>(std::move(elem_parser), std::move(sep_parser));
+    template<typename T, typename U, typename In>
+    Parser<Internal::SeqWithSeps<T, U>, In> seq_save(Parser<T, In> elem_parser, Parser<U, In> sep_parser) {
+        return make_parser<Internal::SeqWithSeps<T, U>, Internal::ISeqSaverParser<T, U, In>>(std::move(elem_parser), std::move(sep_parser));
     }
 
-    template<typename T, typename BL, typename BR>
-    Parser<T> brackets_parser(Parser<BL> left_parser, Parser<T> elem_parser, Parser<BR> right_parser) {
-        return make_parser<T, Internal::IBrParser<T, BL, BR>>(std::move(elem_parser), std::move(left_parser), std::move(right_parser));
+    template<typename T, typename BL, typename BR, typename In>
+    Parser<T, In> brackets_parser(Parser<BL, In> left_parser, Parser<T, In> elem_parser, Parser<BR, In> right_parser) {
+        return make_parser<T, Internal::IBrParser<T, BL, BR, In>>(std::move(elem_parser), std::move(left_parser), std::move(right_parser));
     }
 
-    template<typename T, typename U>
-    Parser<T> fold(Parser<Internal::SeqWithSeps<T, U>> vec_parser, std::vector<std::pair<U, std::function<T(T, T)>>> operators) {
-        return make_parser<T, Internal::IFoldParser<T, U>>(std::move(vec_parser), std::move(operators));
+    template<typename T, typename U, typename In>
+    Parser<T, In> fold(Parser<Internal::SeqWithSeps<T, U>, In> vec_parser, std::vector<std::pair<U, std::function<T(T, T)>>> operators) {
+        return make_parser<T, Internal::IFoldParser<T, U, In>>(std::move(vec_parser), std::move(operators));
     }
 
-    template<typename T>
-    Parser<T> lazy_parser(std::function<Parser<T>()> get_parser) {
-        return make_parser<T, Internal::ILazyParser<T>>(std::move(get_parser));
+    // same as fold(seq_save(elem_parser, sep_parser), operators) but does not allocate while parsing
+    template<typename T, typename U, typename In>
+    Parser<T, In> chain_left(Parser<T, In> elem_parser, Parser<U, In> sep_parser,
+                             std::vector<std::pair<U, std::function<T(T, T)>>> operators) {
+        return make_parser<T, Internal::IChainLeftParser<T, U, In>>(std::move(elem_parser), std::move(sep_parser), std::move(operators));
+    }
+
+    // fails if parser succeeds without consuming input
+    template<typename T, typename In>
+    Parser<T, In> consumes(Parser<T, In> parser) {
+        return make_parser<T, Internal::IConsumesParser<T, In>>(std::move(parser));
+    }
+
+    // Alternation which tries the branch that succeeds most often first, if the branches are
+    // proven to never succeed on the same input (see IAdaptiveAlternativeParser). The order is
+    // revised about every period successes, counted by sampling; name identifies it in
+    // Grammar::save_profile.
+    template<typename T, typename In = std::string_view>
+    Parser<T, In> adaptive_alternative(std::string name, std::vector<Parser<T, In>> branches,
+                                       std::uint64_t period = 1024) {
+        if (branches.empty() || branches.size() > Internal::IAdaptiveAlternativeParser<T, In>::max_branches) {
+            throw std::invalid_argument("adaptive_alternative expects 1 to 16 branches");
+        }
+        return make_parser<T, Internal::IAdaptiveAlternativeParser<T, In>>(std::move(name), std::move(branches), period);
+    }
+
+    // Accepts and rejects what parser does, with the same rest and messages, but never builds
+    // its value: >>, brackets, many, seq and the other nodes inside only advance the input.
+    // Functions of fmap, fold, chain_left, ... are not called, so e.g. overflow is not detected.
+    template<typename T, typename In>
+    Parser<std::monostate, In> discard(Parser<T, In> parser) {
+        return make_parser<std::monostate, Internal::IDiscardParser<T, In>>(std::move(parser));
+    }
+
+    // on failure pretend that nothing was consumed, so enclosing alternatives may backtrack
+    template<typename T, typename In>
+    Parser<T, In> try_(Parser<T, In> parser) {
+        return make_parser<T, Internal::ITryParser<T, In>>(std::move(parser));
+    }
+
+    // commit: failure of parser is final for enclosing alternatives even if nothing was consumed
+    template<typename T, typename In>
+    Parser<T, In> cut(Parser<T, In> parser) {
+        return make_parser<T, Internal::ICutParser<T, In>>(std::move(parser));
+    }
+
+    // rule is built once per arena, so recursive rules form a cycle instead of being rebuilt
+    template<typename T, typename In>
+    Parser<T, In> lazy_parser(Parser<T, In> (*rule)()) {
+        return make_parser<T, Internal::ILazyParser<T, In>>(&Internal::Arena::current(), rule);
+    }
+
+    template<typename T, typename In = std::string_view>
+    Parser<T, In> lazy_parser(std::function<Parser<T, In>()> get_parser) {
+        return make_parser<T, Internal::ILazyParser<T, In>>(&Internal::Arena::current(), std::move(get_parser));
+    }
+
+    // the graph of rule memoised per arena, like lazy_parser but without the indirection:
+    // rule is built right away, so it must not refer to itself
+    template<typename T, typename In>
+    Parser<T, In> rule_parser(Parser<T, In> (*rule)()) {
+        return Parser<T, In>(Internal::Arena::current().rule(rule));
     }
 
-} // namespace Parser
+} // namespace Parser
\ No newline at end of file
@@ -2,302 +2,1408 @@
 
 namespace Parsec {
 
-    template<typename T>
+    template<typename T, typename In>
     struct Parser;
 
+    // thrown when a parse runs out of its Budget: the input is neither accepted nor rejected
+    struct BudgetExceeded : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    // Limits the work of the parses it is installed for: every rule call, alternative and
+    // repetition is a step. The deadline is checked on the first step and then every 1024 steps.
+    class Budget {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit Budget(std::uint64_t max_steps_ = std::numeric_limits<std::uint64_t>::max(),
+                        std::optional<Clock::time_point> deadline_ = std::nullopt)
+            : max_steps(max_steps_), deadline(deadline_) {}
+
+        // steps made so far
+        std::uint64_t steps() const { return used; }
+
+        void charge() {
+            if (++used > max_steps) {
+                throw BudgetExceeded("Step budget exceeded");
+            }
+            if (deadline && (used & 1023) == 1 && Clock::now() > *deadline) {
+                throw BudgetExceeded("Deadline exceeded");
+            }
+        }
+
+    private:
+        std::uint64_t max_steps;
+        std::optional<Clock::time_point> deadline;
+        std::uint64_t used = 0;
+    };
+
     namespace Internal {
 
-        template<typename T>
+        // element type of an input range: char for std::string_view, Token for std::span<const Token>
+        template<typename In>
+        using Elem = std::remove_cv_t<typename In::value_type>;
+
+        // input without its first n elements
+        template<typename In>
+        In drop(In in, std::size_t n) {
+            if constexpr (requires { in.substr(n); }) {
+                return in.substr(n);
+            } else {
+                return in.subspan(n);
+            }
+        }
+
+        // first n elements of input
+        template<typename In>
+        In take(In in, std::size_t n) {
+            if constexpr (requires { in.substr(0, n); }) {
+                return in.substr(0, n);
+            } else {
+                return in.first(n);
+            }
+        }
+
+        template<typename In>
+        bool starts_with(In in, In prefix) {
+            return in.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), in.begin());
+        }
+
+        template<typename T, typename In = std::string_view>
         struct Result {
             explicit Result() = default;
-            explicit Result(T t, std::string_view s)
+            explicit Result(T t, In s)
                 : tvalue(std::move(t)), srest(s), has_value(true) {}
 
             explicit operator bool() { return has_value; }
-            T value() { return tvalue; }
-            std::string_view rest() { return srest; }
+            T& value() & { return tvalue; }
+            T value() && { return std::move(tvalue); }
+            In rest() { return srest; }
 
-            void set_error(std::string msg) {
+            // The message is kept as views to static text, the parser graph and the input and is
+            // joined only by get_message(), so failed alternatives do not allocate.
+            // The message is valid while the grammar and the input are alive.
+            void set_error(std::string_view text, std::string_view detail = {},
+                           std::string_view text2 = {}, std::string_view detail2 = {}) {
                 has_value = false;
-                error_message = std::move(msg);
+                error_parts = {text, detail, text2, detail2};
+            }
+            std::string get_message() {
+                std::string message;
+                for (std::string_view part : error_parts) {
+                    message += part;
+                }
+                return message;
+            }
+
+            // failed after consuming input: enclosing alternatives do not try other branches
+            bool consumed() const { return is_consumed; }
+            void set_consumed(bool consumed_) { is_consumed = consumed_; }
+
+            // failure of another value type with the same message and consumed flag
+            template<typename R>
+            Result<R, In> failure_as() const {
+                Result<R, In> failure;
+                failure.error_parts = error_parts;
+                failure.is_consumed = is_consumed;
+                return failure;
             }
-            std::string get_message() { return error_message; }
+
+            template<typename, typename>
+            friend struct Result;
 
         private:
             T tvalue;
-            std::string_view srest;
+            In srest;
             bool has_value = false;
-            std::string error_message;
+            bool is_consumed = false;
+            std::array<std::string_view, 4> error_parts;
         };
 
-        template<typename T>
-        Result<T> nullres(std::string message) {
-            Result<T> res;
-            res.set_error(std::move(message));
+        // result of IParser::skip: the rest, the message and the consumed flag without a value
+        template<typename In>
+        using Skipped = Result<std::monostate, In>;
+
+        template<typename T, typename In = std::string_view>
+        Result<T, In> nullres(std::string_view text, std::string_view detail = {},
+                              std::string_view text2 = {}, std::string_view detail2 = {}) {
+            Result<T, In> res;
+            res.set_error(text, detail, text2, detail2);
             return res;
         }
 
-        template<typename T>
-        struct IParser {
-            virtual Result<T> parse(std::string_view) = 0;
-            virtual ~IParser() = default;
+        // failure caused by res: consumed if res is, or if input was consumed before res was parsed
+        template<typename R, typename T, typename In>
+        Result<R, In> propagate(Result<T, In>& res, bool consumed_before = false) {
+            Result<R, In> failure = res.template failure_as<R>();
+            failure.set_consumed(consumed_before || res.consumed());
+            return failure;
+        }
+
+        struct INode;
+
+        // Characters a parser graph may consume, collected by walking the graph once.
+        // Characters of the delimiters of brackets_parser are kept apart, so that a prefilter
+        // can check that brackets which are nothing but single char delimiters are balanced.
+        struct Alphabet {
+            std::bitset<256> chars;      // consumed outside of bracket delimiters
+            std::bitset<256> delimiters; // consumed by bracket delimiters, but not as their bracket char
+            std::vector<std::pair<char, char>> brackets;
+            bool any = false;            // some node consumes characters which are not known in advance
+
+            void add(const INode* node);
+
+            template<typename T, typename In>
+            void add(const Parser<T, In>& parser) {
+                add(parser.node());
+            }
+
+            void add_char(char c) {
+                chars.set(static_cast<unsigned char>(c));
+            }
+
+            void add_delimiters(const INode* left, const INode* right);
+
+        private:
+            std::unordered_set<const INode*> visited;
         };
 
-        template<typename T>
-        struct IAlternativeParser : IParser<T> {
-            IAlternativeParser(Parser<T> fst_, Parser<T> snd_)
+        // chars a parser may consume first and whether it may succeed without consuming input
+        struct First {
+            std::bitset<256> chars;
+            bool nullable = false;
+            bool any = false; // first chars are not known
+
+            static First unknown() {
+                First first;
+                first.any = true;
+                return first;
+            }
+
+            First& operator|=(const First& other) {
+                chars |= other.chars;
+                nullable = nullable || other.nullable;
+                any = any || other.any;
+                return *this;
+            }
+        };
+
+        // First of every node of a graph, each computed once; a node reached again
+        // while its own First is computed (left recursion) is unknown
+        struct FirstSets {
+            First of(const INode* node);
+
+            template<typename T, typename In>
+            First of(const Parser<T, In>& parser) {
+                return of(parser.node());
+            }
+
+            // First of parser a followed by parser b
+            template<typename A, typename B>
+            First then(const A& a, const B& b) {
+                First first = of(a);
+                if (first.nullable) {
+                    first.nullable = false;
+                    first |= of(b);
+                }
+                return first;
+            }
+
+        private:
+            std::unordered_map<const INode*, First> done;
+            std::unordered_set<const INode*> active;
+        };
+
+        struct INode {
+            virtual ~INode() = default;
+
+            // unknown unless overridden
+            virtual First first(FirstSets&) const {
+                return First::unknown();
+            }
+
+            // adds the characters consumed by this node and the nodes it refers to,
+            // unknown unless overridden
+            virtual void collect(Alphabet& alphabet) const {
+                alphabet.any = true;
+            }
+
+            // the char this node consumes if it consumes exactly one char and then only spaces
+            virtual std::optional<char> single_char() const {
+                return std::nullopt;
+            }
+        };
+
+        inline First FirstSets::of(const INode* node) {
+            if (auto it = done.find(node); it != done.end()) {
+                return it->second;
+            }
+            if (!active.insert(node).second) {
+                return First::unknown();
+            }
+            First first = node->first(*this);
+            active.erase(node);
+            done.emplace(node, first);
+            return first;
+        }
+
+        inline void Alphabet::add(const INode* node) {
+            if (visited.insert(node).second) {
+                node->collect(*this);
+            }
+        }
+
+        // delimiters are walked separately, a node which is also reached outside of
+        // the delimiters lands in chars and turns the bracket check off
+        inline void Alphabet::add_delimiters(const INode* left, const INode* right) {
+            std::optional<char> open = left->single_char(), close = right->single_char();
+            bool pair = open && close && *open != *close;
+            for (const INode* node : {left, right}) {
+                Alphabet sub;
+                sub.add(node);
+                any = any || sub.any;
+                if (pair) {
+                    sub.chars.reset(static_cast<unsigned char>(node == left ? *open : *close));
+                }
+                delimiters |= sub.chars | sub.delimiters;
+                brackets.insert(brackets.end(), sub.brackets.begin(), sub.brackets.end());
+            }
+            if (pair && std::find(brackets.begin(), brackets.end(), std::pair(*open, *close)) == brackets.end()) {
+                brackets.emplace_back(*open, *close);
+            }
+        }
+
+        template<typename T, typename In = std::string_view>
+        struct IParser : INode {
+            using input_type = In;
+
+            virtual Result<T, In> parse(In) const = 0;
+
+            // Recognises what parse() would: the same rest, message and consumed flag, but no value
+            // is built. Nodes whose outcome does not depend on the values of their children skip
+            // the children too, so the functions of fmap, merge, fold and chain nodes are not
+            // called in this mode and errors they throw (overflow) are not detected. parse() never
+            // enters it, not even for children whose values it drops: only discard() does.
+            virtual Skipped<In> skip(In str) const {
+                auto result = parse(str);
+                if (!result) {
+                    return result.template failure_as<std::monostate>();
+                }
+                return Skipped<In>{std::monostate{}, result.rest()};
+            }
+        };
+
+        // lazy nodes are resolved by the arena once the whole graph is built
+        struct ILazyNode {
+            virtual void resolve() const = 0;
+            virtual ~ILazyNode() = default;
+        };
+
+        // node with a learned state which Grammar can save and load, see adaptive_alternative
+        struct IProfiledNode {
+            virtual const std::string& name() const = 0;
+            virtual std::vector<std::size_t> order() const = 0;
+            virtual bool set_order(const std::vector<std::size_t>& order) const = 0;
+            virtual ~IProfiledNode() = default;
+        };
+
+        template<typename A>
+        struct IsParser : std::false_type {};
+
+        template<typename T, typename In>
+        struct IsParser<Parser<T, In>> : std::true_type {};
+
+        template<typename A>
+        struct IsString : std::false_type {};
+
+        template<typename C>
+        struct IsString<std::basic_string_view<C>> : std::true_type {};
+
+        template<typename C>
+        struct IsString<std::basic_string<C>> : std::true_type {};
+
+        // Constructor arguments by which two nodes of one type are interchangeable: parsers
+        // (compared by node), strings (compared by content, so nodes keep a copy of them),
+        // stateless functors (their type is a part of the node type) and objects without padding,
+        // compared by their bytes: numbers, pointers and lambdas capturing such values by copy.
+        // Nodes built from anything else, like std::function or lambdas capturing by reference,
+        // are never shared.
+        template<typename A>
+        constexpr bool is_key_arg() {
+            using D = std::remove_cvref_t<A>;
+            return IsParser<D>::value || IsString<D>::value || std::has_unique_object_representations_v<D>
+                || (std::is_empty_v<D> && std::is_trivially_copyable_v<D>);
+        }
+
+        template<typename A>
+        void append_key(std::string& key, const A& arg) {
+            using D = std::remove_cvref_t<A>;
+            if constexpr (IsParser<D>::value) {
+                auto* node = arg.node();
+                key.append(reinterpret_cast<const char*>(&node), sizeof(node));
+            } else if constexpr (IsString<D>::value) {
+                std::size_t size = arg.size();
+                key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+                key.append(reinterpret_cast<const char*>(arg.data()), size * sizeof(arg[0]));
+            } else if constexpr (!std::is_empty_v<D>) {
+                key.append(reinterpret_cast<const char*>(&arg), sizeof(arg));
+            }
+        }
+
+        // Owns every node of a parser graph. Nodes refer to each other by plain pointers,
+        // so copying a Parser is free and parsing never touches a reference counter.
+        // Rules (lazy parsers built from a plain function) are memoised per arena,
+        // which makes recursive grammars a finite cyclic graph instead of an infinite tree.
+        // Nodes are hash-consed: a node of the same type built from the same key arguments
+        // (see is_key_arg) is the existing one, so identical subgraphs are stored once.
+        class Arena {
+        public:
+            template<typename R, typename... Args>
+            R* make(Args&&... args) {
+                std::lock_guard lock(mutex);
+                std::string key;
+                // profiled nodes learn from their own traffic, so they are never shared
+                if constexpr (!std::is_base_of_v<IProfiledNode, R> && (is_key_arg<Args>() && ...)) {
+                    key = typeid(R).name();
+                    key += '\0';
+                    (append_key(key, args), ...);
+                    auto it = shared.find(key);
+                    if (it != shared.end()) {
+                        ++reused_count;
+                        return static_cast<R*>(it->second);
+                    }
+                }
+                auto node = std::make_unique<R>(std::forward<Args>(args)...);
+                R* ptr = node.get();
+                nodes.push_back(std::move(node));
+                if (!key.empty()) {
+                    shared.emplace(std::move(key), ptr);
+                }
+                if constexpr (std::is_base_of_v<ILazyNode, R>) {
+                    lazies.push_back(ptr);
+                }
+                if constexpr (std::is_base_of_v<IProfiledNode, R>) {
+                    profiled.push_back(ptr);
+                }
+                return ptr;
+            }
+
+            template<typename T, typename In>
+            IParser<T, In>* rule(Parser<T, In> (*builder)()) {
+                std::lock_guard lock(mutex);
+                auto key = reinterpret_cast<void (*)()>(builder);
+                auto it = rules.find(key);
+                if (it != rules.end()) {
+                    return static_cast<IParser<T, In>*>(it->second);
+                }
+                Scope scope(*this);
+                IParser<T, In>* root = builder().node();
+                rules.emplace(key, root);
+                return root;
+            }
+
+            template<typename T, typename In>
+            IParser<T, In>* build(const std::function<Parser<T, In>()>& builder) {
+                std::lock_guard lock(mutex);
+                Scope scope(*this);
+                return builder().node();
+            }
+
+            // resolves every lazy node, including the ones created while resolving
+            void resolve_rules() {
+                std::lock_guard lock(mutex);
+                for (std::size_t i = 0; i < lazies.size(); ++i) {
+                    lazies[i]->resolve();
+                }
+            }
+
+            std::size_t size() const {
+                std::lock_guard lock(mutex);
+                return nodes.size();
+            }
+
+            // nodes asked for by builders which turned out to be already in the arena
+            std::size_t reused() const {
+                std::lock_guard lock(mutex);
+                return reused_count;
+            }
+
+            std::vector<const IProfiledNode*> profiled_nodes() const {
+                std::lock_guard lock(mutex);
+                return profiled;
+            }
+
+            // arena used by make_parser on this thread: the innermost Scope or the global one
+            static Arena& current() {
+                return active() ? *active() : global();
+            }
+
+            // parsers built outside of any Grammar live here until the program exits
+            static Arena& global() {
+                static Arena arena;
+                return arena;
+            }
+
+            struct Scope {
+                explicit Scope(Arena& arena) : prev(active()) { active() = &arena; }
+                ~Scope() { active() = prev; }
+
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+            private:
+                Arena* prev;
+            };
+
+        private:
+            static Arena*& active() {
+                static thread_local Arena* arena = nullptr;
+                return arena;
+            }
+
+            mutable std::recursive_mutex mutex;
+            std::vector<std::unique_ptr<INode>> nodes;
+            std::vector<const ILazyNode*> lazies;
+            std::vector<const IProfiledNode*> profiled;
+            std::unordered_map<void (*)(), INode*> rules;
+            std::unordered_map<std::string, INode*> shared;
+            std::size_t reused_count = 0;
+        };
+
+        // budget of the parses on this thread, none outside of a BudgetScope
+        inline Budget*& active_budget() {
+            static thread_local Budget* budget = nullptr;
+            return budget;
+        }
+
+        // one step of the active budget; without a budget it is a single thread local load
+        inline void charge() {
+            if (Budget* budget = active_budget()) {
+                budget->charge();
+            }
+        }
+
+        struct BudgetScope {
+            explicit BudgetScope(Budget& budget) : prev(active_budget()) { active_budget() = &budget; }
+            ~BudgetScope() { active_budget() = prev; }
+
+            BudgetScope(const BudgetScope&) = delete;
+            BudgetScope& operator=(const BudgetScope&) = delete;
+        private:
+            Budget* prev;
+        };
+
+        template<typename T, typename In>
+        struct IAlternativeParser : IParser<T, In> {
+            IAlternativeParser(Parser<T, In> fst_, Parser<T, In> snd_)
                     : fst(std::move(fst_)), snd(std::move(snd_)) {}
 
-            Result<T> parse(std::string_view s) override {
+            Result<T, In> parse(In s) const override {
+                charge();
                 auto fst_result = fst.parse(s);
-                if (fst_result) {
+                if (fst_result || fst_result.consumed()) {
                     return fst_result;
                 }
                 return snd.parse(s);
             }
 
+            Skipped<In> skip(In s) const override {
+                charge();
+                auto fst_result = fst.skip(s);
+                if (fst_result || fst_result.consumed()) {
+                    return fst_result;
+                }
+                return snd.skip(s);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(fst);
+                alphabet.add(snd);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(fst);
+                first |= sets.of(snd);
+                return first;
+            }
+
         private:
-            Parser<T> fst, snd;
+            Parser<T, In> fst, snd;
         };
 
-        struct ICharParser : IParser<char> {
-            explicit ICharParser(char target_) : target(target_) {}
+        // matches one element equal to target
+        template<typename In>
+        struct ICharParser : IParser<Elem<In>, In> {
+            using E = Elem<In>;
+
+            explicit ICharParser(E target_) : target(std::move(target_)) {}
 
-            Result<char> parse(std::string_view str) override {
-                if (str.empty() || str[0] != target) {
-                    std::string msg = "Expected ";
-                    msg.push_back(target);
-                    msg.append(". But received ");
-                    msg.push_back(str[0]);
-                    return nullres<char>(std::move(msg));
+            Result<E, In> parse(In str) const override {
+                if (str.empty() || !(str[0] == target)) {
+                    if constexpr (std::is_same_v<E, char>) {
+                        if (str.empty()) {
+                            return nullres<E, In>("Expected ", {&target, 1}, ". But string is empty");
+                        }
+                        return nullres<E, In>("Expected ", {&target, 1}, ". But received ", str.substr(0, 1));
+                    } else {
+                        return nullres<E, In>(str.empty() ? "Expected element. But string is empty"
+                                                          : "Expected element");
+                    }
+                }
+                return Result<E, In>{target, drop(str, 1)};
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                if constexpr (std::is_same_v<E, char>) {
+                    alphabet.add_char(target);
+                } else {
+                    alphabet.any = true;
+                }
+            }
+
+            First first(FirstSets&) const override {
+                if constexpr (std::is_same_v<E, char>) {
+                    First first;
+                    first.chars.set(static_cast<unsigned char>(target));
+                    return first;
+                } else {
+                    return First::unknown();
+                }
+            }
+
+            std::optional<char> single_char() const override {
+                if constexpr (std::is_same_v<E, char>) {
+                    return target;
+                } else {
+                    return std::nullopt;
                 }
-                std::string_view rest = str.substr(1);
-                return Result<char>{target, rest};
             }
 
         private:
-            char target = 0;
+            E target;
         };
 
-        struct ICharsParser : IParser<char> {
-            explicit ICharsParser(std::vector<char> chars) : targets(std::move(chars)) {}
+        template<typename In>
+        struct ICharsParser : IParser<Elem<In>, In> {
+            using E = Elem<In>;
+
+            explicit ICharsParser(std::vector<E> chars) : targets(std::move(chars)) {}
 
-            Result<char> parse(std::string_view str) override {
+            Result<E, In> parse(In str) const override {
                 if (str.empty()) {
-                    return nullres<char>("Expected chars but string is empty.");
+                    return nullres<E, In>("Expected chars but string is empty.");
                 }
-                for (char c : targets) {
+                for (const E& c : targets) {
                     if (str[0] == c) {
-                        std::string_view rest = str.substr(1);
-                        return Result<char>{c, rest};
+                        return Result<E, In>{c, drop(str, 1)};
+                    }
+                }
+                return nullres<E, In>("Expected chars but not matched");
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                if constexpr (std::is_same_v<E, char>) {
+                    for (char c : targets) {
+                        alphabet.add_char(c);
+                    }
+                } else {
+                    alphabet.any = true;
+                }
+            }
+
+            First first(FirstSets&) const override {
+                if constexpr (std::is_same_v<E, char>) {
+                    First first;
+                    for (char c : targets) {
+                        first.chars.set(static_cast<unsigned char>(c));
+                    }
+                    return first;
+                } else {
+                    return First::unknown();
+                }
+            }
+
+        private:
+            std::vector<E> targets;
+        };
+
+        // matches one element for which pred returns true
+        template<typename In, typename Pred>
+        struct ISatisfyParser : IParser<Elem<In>, In> {
+            using E = Elem<In>;
+
+            explicit ISatisfyParser(Pred pred_) : pred(std::move(pred_)) {}
+
+            Result<E, In> parse(In str) const override {
+                if (str.empty()) {
+                    return nullres<E, In>("Expected element but string is empty.");
+                }
+                if (!pred(str[0])) {
+                    return nullres<E, In>("Element not satisfied.");
+                }
+                return Result<E, In>{str[0], drop(str, 1)};
+            }
+
+        private:
+            Pred pred;
+        };
+
+        // Decimal number at the start of the input read by std::from_chars: digits with an optional
+        // '-' if Sign, for floating T also a fraction and an exponent. A number which does not fit
+        // into T is a failure which consumed input, so alternatives do not read it another way.
+        template<typename T, bool Sign>
+        struct INumberParser : IParser<T, std::string_view> {
+            Result<T, std::string_view> parse(std::string_view str) const override {
+                std::size_t start = Sign && !str.empty() && str[0] == '-' ? 1 : 0;
+                if (str.size() <= start || !(is_digit(str[start]) || (std::is_floating_point_v<T> && str[start] == '.'))) {
+                    return nullres<T>("Expected number");
+                }
+                T value{};
+                auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+                if (error == std::errc::result_out_of_range) {
+                    auto failure = nullres<T>("Number is out of range");
+                    failure.set_consumed(true);
+                    return failure;
+                }
+                if (error != std::errc()) {
+                    return nullres<T>("Expected number");
+                }
+                return Result<T, std::string_view>{value, str.substr(end - str.data())};
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                for (char c : std::string_view(std::is_floating_point_v<T> ? "0123456789.eE+-" : "0123456789-")) {
+                    if (c != '-' || Sign || std::is_floating_point_v<T>) {
+                        alphabet.add_char(c);
                     }
                 }
-                return nullres<char>("Expected chars but not matched");
+            }
+
+            First first(FirstSets&) const override {
+                First first;
+                for (char c = '0'; c <= '9'; ++c) {
+                    first.chars.set(static_cast<unsigned char>(c));
+                }
+                if constexpr (Sign) {
+                    first.chars.set('-');
+                }
+                if constexpr (std::is_floating_point_v<T>) {
+                    first.chars.set('.');
+                }
+                return first;
             }
 
         private:
-            std::vector<char> targets;
+            static bool is_digit(char c) {
+                return c >= '0' && c <= '9';
+            }
         };
 
-        struct IPrefixParser : IParser<std::string_view> {
-            explicit IPrefixParser(std::string_view target_)
-                : target(target_) {}
+        // a string target is copied into the node: nodes are shared by the content of their
+        // strings, so a view could outlive the buffer of whoever built the node first
+        template<typename In>
+        struct IPrefixParser : IParser<In, In> {
+            explicit IPrefixParser(In target_)
+                : storage(target_.begin(), target_.end()), target(storage.data(), storage.size()) {}
 
-            Result<std::string_view> parse(std::string_view str) override {
-                bool starts_with_target = true;
-                for (std::size_t i = 0; i < target.size(); ++i) {
-                    starts_with_target &= target[i] == str[i];
+            Result<In, In> parse(In str) const override {
+                if (!starts_with(str, target)) {
+                    if constexpr (std::is_same_v<In, std::string_view>) {
+                        return nullres<In, In>("Expected prefix ", target);
+                    } else {
+                        return nullres<In, In>("Expected prefix");
+                    }
                 }
-                if (!starts_with_target) {
-                    std::string msg = "Expected prefix ";
-                    msg += target;
-                    return nullres<std::string_view>(std::move(msg));
+                return Result<In, In>(target, drop(str, target.size()));
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                if constexpr (std::is_same_v<Elem<In>, char>) {
+                    for (char c : target) {
+                        alphabet.add_char(c);
+                    }
+                } else {
+                    alphabet.any = true;
+                }
+            }
+
+            First first(FirstSets&) const override {
+                if constexpr (std::is_same_v<Elem<In>, char>) {
+                    First first;
+                    if (target.empty()) {
+                        first.nullable = true;
+                    } else {
+                        first.chars.set(static_cast<unsigned char>(target[0]));
+                    }
+                    return first;
+                } else {
+                    return First::unknown();
                 }
-                return Result<std::string_view>(target, str.substr(target.size()));
             }
         private:
-            std::string_view target;
+            std::conditional_t<IsString<In>::value, std::basic_string<Elem<In>>, In> storage;
+            In target;
         };
 
-        template<typename T>
-        struct IManyParser : IParser<std::vector<T>> {
-            explicit IManyParser(Parser<T> p) : parser(std::move(p)) {}
+        // skips parser as many times as it matches, skip() of the many family
+        template<typename T, typename In>
+        Skipped<In> skip_many_of(const Parser<T, In>& parser, In str) {
+            while (true) {
+                charge();
+                auto current_res = parser.skip(str);
+                if (!current_res) {
+                    if (current_res.consumed()) {
+                        return current_res;
+                    }
+                    break;
+                }
+                str = current_res.rest();
+            }
+            return Skipped<In>{std::monostate{}, str};
+        }
 
-            Result<std::vector<T>> parse(std::string_view str) override {
+        template<typename T, typename In>
+        struct IManyParser : IParser<std::vector<T>, In> {
+            explicit IManyParser(Parser<T, In> p) : parser(std::move(p)) {}
+
+            Result<std::vector<T>, In> parse(In str) const override {
                 std::vector<T> results;
                 while (true) {
+                    charge();
                     auto current_res = parser.parse(str);
                     if (!current_res) {
+                        if (current_res.consumed()) {
+                            return propagate<std::vector<T>>(current_res);
+                        }
                         break;
                     }
                     results.push_back(current_res.value());
                     str = current_res.rest();
                 }
-                return Result<std::vector<T>>{results, str};
+                return Result<std::vector<T>, In>{results, str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_many_of(parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                first.nullable = true;
+                return first;
             }
         private:
-            Parser<T> parser;
+            Parser<T, In> parser;
         };
 
         // like IManyParser but ignores the second occurrence and beyond
-        template<typename T>
-        struct IManyIgnoreParser : IParser<T> {
-            explicit IManyIgnoreParser(Parser<T> p) : parser(std::move(p)) {}
+        template<typename T, typename In>
+        struct IManyIgnoreParser : IParser<T, In> {
+            explicit IManyIgnoreParser(Parser<T, In> p) : parser(std::move(p)) {}
 
-            Result<T> parse(std::string_view str) override {
-                auto many = Parser<std::vector<T>>(std::make_shared<Internal::IManyParser<T>>(parser));
-                auto many_result = many.parse(str);
-                if (many_result.value().empty()) {
-                    return Result<T>{0, many_result.rest()};
+            Result<T, In> parse(In str) const override {
+                T first{};
+                bool matched = false;
+                while (true) {
+                    charge();
+                    auto current_res = parser.parse(str);
+                    if (!current_res) {
+                        if (current_res.consumed()) {
+                            return propagate<T>(current_res);
+                        }
+                        break;
+                    }
+                    if (!matched) {
+                        first = current_res.value();
+                        matched = true;
+                    }
+                    str = current_res.rest();
                 }
-                return Result<T>{many_result.value()[0], many_result.rest()};
+                return Result<T, In>{first, str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_many_of(parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                first.nullable = true;
+                return first;
             }
         private:
-            Parser<T> parser;
+            Parser<T, In> parser;
         };
 
-        template<typename T, typename U, typename R, typename Func>
-        struct IMergeParser : IParser<R> {
-            explicit IMergeParser(Parser<T> p1_, Parser<U> p2_, Func f_)
+        // like IManyParser but only counts the occurrences
+        template<typename T, typename In>
+        struct ICountManyParser : IParser<std::size_t, In> {
+            explicit ICountManyParser(Parser<T, In> p) : parser(std::move(p)) {}
+
+            Result<std::size_t, In> parse(In str) const override {
+                std::size_t count = 0;
+                while (true) {
+                    charge();
+                    auto current_res = parser.parse(str);
+                    if (!current_res) {
+                        if (current_res.consumed()) {
+                            return propagate<std::size_t>(current_res);
+                        }
+                        break;
+                    }
+                    ++count;
+                    str = current_res.rest();
+                }
+                return Result<std::size_t, In>{count, str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_many_of(parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                first.nullable = true;
+                return first;
+            }
+        private:
+            Parser<T, In> parser;
+        };
+
+        // like IManyParser but drops the results
+        template<typename T, typename In>
+        struct ISkipManyParser : IParser<std::monostate, In> {
+            explicit ISkipManyParser(Parser<T, In> p) : parser(std::move(p)) {}
+
+            Result<std::monostate, In> parse(In str) const override {
+                while (true) {
+                    charge();
+                    auto current_res = parser.parse(str);
+                    if (!current_res) {
+                        if (current_res.consumed()) {
+                            return propagate<std::monostate>(current_res);
+                        }
+                        break;
+                    }
+                    str = current_res.rest();
+                }
+                return Result<std::monostate, In>{std::monostate{}, str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_many_of(parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                first.nullable = true;
+                return first;
+            }
+        private:
+            Parser<T, In> parser;
+        };
+
+        // like IManyParser but accumulates the results with f(acc, value) starting from init
+        template<typename T, typename R, typename Func, typename In>
+        struct IFoldManyParser : IParser<R, In> {
+            explicit IFoldManyParser(Parser<T, In> p, R init_, Func f_)
+                : parser(std::move(p)), init(std::move(init_)), f(std::move(f_)) {}
+
+            Result<R, In> parse(In str) const override {
+                R acc = init;
+                while (true) {
+                    charge();
+                    auto current_res = parser.parse(str);
+                    if (!current_res) {
+                        if (current_res.consumed()) {
+                            return propagate<R>(current_res);
+                        }
+                        break;
+                    }
+                    acc = f(std::move(acc), current_res.value());
+                    str = current_res.rest();
+                }
+                return Result<R, In>{std::move(acc), str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_many_of(parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                first.nullable = true;
+                return first;
+            }
+        private:
+            Parser<T, In> parser;
+            R init;
+            Func f;
+        };
+
+        // returns the part of the input consumed by parser instead of its value
+        template<typename T, typename In>
+        struct ICaptureParser : IParser<In, In> {
+            explicit ICaptureParser(Parser<T, In> p) : parser(std::move(p)) {}
+
+            Result<In, In> parse(In str) const override {
+                auto result = parser.parse(str);
+                if (!result) {
+                    return propagate<In>(result);
+                }
+                return Result<In, In>{take(str, str.size() - result.rest().size()), result.rest()};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return parser.skip(str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.of(parser);
+            }
+        private:
+            Parser<T, In> parser;
+        };
+
+        template<typename C>
+        bool is_space(C c) {
+            return c == C(' ') || c == C('\t');
+        }
+
+        template<typename In>
+        In skip_spaces(In str) {
+            std::size_t i = 0;
+            while (i < str.size() && is_space(str[i])) {
+                ++i;
+            }
+            return drop(str, i);
+        }
+
+        template<typename In>
+        void collect_spaces(Alphabet& alphabet) {
+            if constexpr (std::is_same_v<Elem<In>, char>) {
+                for (int c = 0; c < 256; ++c) {
+                    if (is_space(static_cast<char>(c))) {
+                        alphabet.add_char(static_cast<char>(c));
+                    }
+                }
+            } else {
+                alphabet.any = true;
+            }
+        }
+
+        template<typename In>
+        First first_spaces() {
+            if constexpr (std::is_same_v<Elem<In>, char>) {
+                First first;
+                for (int c = 0; c < 256; ++c) {
+                    if (is_space(static_cast<char>(c))) {
+                        first.chars.set(c);
+                    }
+                }
+                first.nullable = true;
+                return first;
+            } else {
+                return First::unknown();
+            }
+        }
+
+        // like IManyIgnoreParser(space) but scans the input directly, returns first space or 0
+        template<typename In>
+        struct ISpacesParser : IParser<Elem<In>, In> {
+            using E = Elem<In>;
+
+            Result<E, In> parse(In str) const override {
+                E first = !str.empty() && is_space(str[0]) ? str[0] : E(0);
+                return Result<E, In>{first, skip_spaces(str)};
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                collect_spaces<In>(alphabet);
+            }
+
+            First first(FirstSets&) const override {
+                return first_spaces<In>();
+            }
+        };
+
+        // parses with parser and skips trailing spaces
+        template<typename T, typename In>
+        struct ILexemeParser : IParser<T, In> {
+            explicit ILexemeParser(Parser<T, In> parser_) : parser(std::move(parser_)) {}
+
+            Result<T, In> parse(In str) const override {
+                auto result = parser.parse(str);
+                if (!result) {
+                    return result;
+                }
+                return Result<T, In>{result.value(), skip_spaces(result.rest())};
+            }
+
+            Skipped<In> skip(In str) const override {
+                auto result = parser.skip(str);
+                if (!result) {
+                    return result;
+                }
+                return Skipped<In>{std::monostate{}, skip_spaces(result.rest())};
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+                collect_spaces<In>(alphabet);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                if (first.nullable) {
+                    first |= first_spaces<In>();
+                }
+                return first;
+            }
+
+            std::optional<char> single_char() const override {
+                return parser.node()->single_char();
+            }
+        private:
+            Parser<T, In> parser;
+        };
+
+        template<typename T, typename U, typename R, typename Func, typename In>
+        struct IMergeParser : IParser<R, In> {
+            explicit IMergeParser(Parser<T, In> p1_, Parser<U, In> p2_, Func f_)
                 : p1(std::move(p1_)), p2(std::move(p2_)), f(std::move(f_)) {}
 
-            Result<R> parse(std::string_view str) override {
+            Result<R, In> parse(In str) const override {
                 auto res1 = p1.parse(str);
                 if (!res1) {
-                    return nullres<R>(res1.get_message());
+                    return propagate<R>(res1);
                 }
                 auto res2 = p2.parse(res1.rest());
                 if (!res2) {
-                    return nullres<R>(res2.get_message());
+                    return propagate<R>(res2, res1.rest().size() != str.size());
                 }
-                return Result<R>(f(res1.value(), res2.value()), res2.rest());
+                return Result<R, In>(f(res1.value(), res2.value()), res2.rest());
+            }
+
+            Skipped<In> skip(In str) const override {
+                auto res1 = p1.skip(str);
+                if (!res1) {
+                    return res1;
+                }
+                auto res2 = p2.skip(res1.rest());
+                if (!res2) {
+                    return propagate<std::monostate>(res2, res1.rest().size() != str.size());
+                }
+                return res2;
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(p1);
+                alphabet.add(p2);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.then(p1, p2);
             }
         private:
-            Parser<T> p1;
-            Parser<U> p2;
+            Parser<T, In> p1;
+            Parser<U, In> p2;
             Func f;
         };
 
-        template<typename T>
-        struct IEmptyParser : IParser<T> {
+        template<typename T, typename In>
+        struct IEmptyParser : IParser<T, In> {
             explicit IEmptyParser(T t) : target(std::move(t)) {}
 
-            Result<T> parse(std::string_view str) override {
+            Result<T, In> parse(In str) const override {
+                if (!str.empty()) {
+                    return nullres<T, In>("Expected empty string.");
+                }
+                return Result<T, In>(target, str);
+            }
+
+            Skipped<In> skip(In str) const override {
                 if (!str.empty()) {
-                    return nullres<T>("Expected empty string.");
+                    return nullres<std::monostate, In>("Expected empty string.");
                 }
-                return Result<T>(target, str);
+                return Skipped<In>{std::monostate{}, str};
+            }
+
+            void collect(Alphabet&) const override {}
+
+            First first(FirstSets&) const override {
+                First first;
+                first.nullable = true;
+                return first;
             }
         private:
             T target;
         };
 
-        template<typename T>
-        struct INotEmptyParser : IParser<T> {
-            explicit INotEmptyParser(Parser<T> parser_)
+        template<typename T, typename In>
+        struct INotEmptyParser : IParser<T, In> {
+            explicit INotEmptyParser(Parser<T, In> parser_)
                 : parser(std::move(parser_)) {}
 
-            Result<T> parse(std::string_view str) override {
+            Result<T, In> parse(In str) const override {
                 if (str.empty()) {
-                    return nullres<T>("Expected not empty string.");
+                    return nullres<T, In>("Expected not empty string.");
                 }
                 return parser.parse(str);
             }
+
+            Skipped<In> skip(In str) const override {
+                if (str.empty()) {
+                    return nullres<std::monostate, In>("Expected not empty string.");
+                }
+                return parser.skip(str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.of(parser);
+            }
         private:
-            Parser<T> parser;
+            Parser<T, In> parser;
         };
 
-        template<typename U, typename T>
-        struct ISkipParser : IParser<T> {
-            explicit ISkipParser(Parser<U> skip_parser_, Parser<T> parser_)
+        template<typename U, typename T, typename In>
+        struct ISkipParser : IParser<T, In> {
+            explicit ISkipParser(Parser<U, In> skip_parser_, Parser<T, In> parser_)
                     : skip_parser(skip_parser_), parser(parser_) {}
 
-            Result<T> parse(std::string_view str) override {
+            Result<T, In> parse(In str) const override {
                 auto res_skip = skip_parser.parse(str);
                 if (!res_skip) {
-                    return nullres<T>(res_skip.get_message());
+                    return propagate<T>(res_skip);
                 }
-                str = res_skip.rest();
-                return parser.parse(str);
+                auto result = parser.parse(res_skip.rest());
+                if (!result && res_skip.rest().size() != str.size()) {
+                    result.set_consumed(true);
+                }
+                return result;
+            }
+
+            Skipped<In> skip(In str) const override {
+                auto res_skip = skip_parser.skip(str);
+                if (!res_skip) {
+                    return res_skip;
+                }
+                auto result = parser.skip(res_skip.rest());
+                if (!result && res_skip.rest().size() != str.size()) {
+                    result.set_consumed(true);
+                }
+                return result;
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(skip_parser);
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.then(skip_parser, parser);
             }
         private:
-            Parser<U> skip_parser;
-            Parser<T> parser;
+            Parser<U, In> skip_parser;
+            Parser<T, In> parser;
         };
 
-        template<typename T, typename U>
-        struct ISeqParser : IParser<std::vector<T>> {
-            explicit ISeqParser(Parser<T> elem_parser_, Parser<U> sep_parser_)
+        // skips elem (sep elem)*, skip() of seq, seq_save and chain_left
+        template<typename T, typename U, typename In>
+        Skipped<In> skip_seq_of(const Parser<T, In>& elem_parser, const Parser<U, In>& sep_parser, In str) {
+            auto head = elem_parser.skip(str);
+            if (!head) {
+                return head;
+            }
+            str = head.rest();
+            while (true) {
+                charge();
+                auto sep_result = sep_parser.skip(str);
+                if (!sep_result) {
+                    if (sep_result.consumed()) {
+                        return sep_result;
+                    }
+                    break;
+                }
+                auto elem_result = elem_parser.skip(sep_result.rest());
+                if (!elem_result) {
+                    bool sep_consumed = sep_result.rest().size() != str.size();
+                    if (sep_consumed || elem_result.consumed()) {
+                        return propagate<std::monostate>(elem_result, sep_consumed);
+                    }
+                    break;
+                }
+                str = elem_result.rest();
+            }
+            return Skipped<In>{std::monostate{}, str};
+        }
+
+        template<typename T, typename U, typename In>
+        struct ISeqParser : IParser<std::vector<T>, In> {
+            explicit ISeqParser(Parser<T, In> elem_parser_, Parser<U, In> sep_parser_)
                     : elem_parser(elem_parser_), sep_parser(sep_parser_) {}
 
-            Result<std::vector<T>> parse(std::string_view str) override {
+            Result<std::vector<T>, In> parse(In str) const override {
                 auto head = elem_parser.parse(str);
                 if (!head) {
-                    return nullres<std::vector<T>>(head.get_message());
+                    return propagate<std::vector<T>>(head);
                 }
                 std::vector<T> results = {head.value()};
                 str = head.rest();
-                auto tail_parser = many(sep_parser >> elem_parser);
-                auto tail = tail_parser.parse(str);
-                for (T t : tail.value()) {
-                    results.push_back(t);
+                while (true) {
+                    charge();
+                    auto sep_result = sep_parser.parse(str);
+                    if (!sep_result) {
+                        if (sep_result.consumed()) {
+                            return propagate<std::vector<T>>(sep_result);
+                        }
+                        break;
+                    }
+                    auto elem_result = elem_parser.parse(sep_result.rest());
+                    if (!elem_result) {
+                        bool sep_consumed = sep_result.rest().size() != str.size();
+                        if (sep_consumed || elem_result.consumed()) {
+                            return propagate<std::vector<T>>(elem_result, sep_consumed);
+                        }
+                        break;
+                    }
+                    results.push_back(elem_result.value());
+                    str = elem_result.rest();
+                }
+                return Result<std::vector<T>, In>{results, str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_seq_of(elem_parser, sep_parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(elem_parser);
+                alphabet.add(sep_parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(elem_parser);
+                if (first.nullable) {
+                    First sep = sets.of(sep_parser);
+                    sep.nullable = true;
+                    first |= sep;
                 }
-                return Result<std::vector<T>>{results, tail.rest()};
+                return first;
             }
         private:
-            Parser<T> elem_parser;
-            Parser<U> sep_parser;
+            Parser<T, In> elem_parser;
+            Parser<U, In> sep_parser;
         };
 
-        template<typename T>
-        struct IBanParser : IParser<T> {
-            explicit IBanParser(Parser<T> parser_, T val)
+        template<typename T, typename In>
+        struct IBanParser : IParser<T, In> {
+            explicit IBanParser(Parser<T, In> parser_, T val)
                 : parser(std::move(parser_)), ban_value(std::move(val)) {}
 
-            Result<T> parse(std::string_view str) override {
+            Result<T, In> parse(In str) const override {
                 auto res = parser.parse(str);
                 if (!res) {
-                    return nullres<T>(res.get_message());
+                    return propagate<T>(res);
                 }
                 if (res.value() == ban_value) {
-                    return nullres<T>("Expected any value except banned value.");
+                    auto banned = nullres<T, In>("Expected any value except banned value.");
+                    banned.set_consumed(res.rest().size() != str.size());
+                    return banned;
                 }
                 return res;
             }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.of(parser);
+            }
         private:
-            Parser<T> parser;
+            Parser<T, In> parser;
             T ban_value;
         };
 
-        template<typename T, typename BL, typename BR>
-        struct IBrParser : IParser<T> {
-            explicit IBrParser(Parser<T> elem_parser_,
-                               Parser<BL> left_parser_,
-                               Parser<BR> right_parser_)
+        template<typename T, typename BL, typename BR, typename In>
+        struct IBrParser : IParser<T, In> {
+            explicit IBrParser(Parser<T, In> elem_parser_,
+                               Parser<BL, In> left_parser_,
+                               Parser<BR, In> right_parser_)
                     : elem_parser(elem_parser_), left_parser(left_parser_), right_parser(right_parser_) {}
 
-            Result<T> parse(std::string_view str) override {
-                auto left_result = left_parser.parse(str);
+            Result<T, In> parse(In str) const override {
+                return enclose<T>(str, [](const auto& parser, In s) { return parser.parse(s); });
+            }
+
+            Skipped<In> skip(In str) const override {
+                return enclose<std::monostate>(str, [](const auto& parser, In s) { return parser.skip(s); });
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(elem_parser);
+                alphabet.add_delimiters(left_parser.node(), right_parser.node());
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(left_parser);
+                if (first.nullable) {
+                    first.nullable = false;
+                    first |= sets.then(elem_parser, right_parser);
+                }
+                return first;
+            }
+        private:
+            // step parses or skips the brackets and the element alike: parse() runs the functions
+            // inside the brackets too, so they may throw as usual
+            template<typename R, typename Step>
+            Result<R, In> enclose(In str, Step step) const {
+                auto left_result = step(left_parser, str);
                 if (!left_result) {
-                    return nullres<T>(left_result.get_message());
+                    return propagate<R>(left_result);
                 }
-                str = left_result.rest();
-                auto elem_result = elem_parser.parse(str);
+                auto elem_result = step(elem_parser, left_result.rest());
                 if (!elem_result) {
-                    return nullres<T>(elem_result.get_message());
+                    return propagate<R>(elem_result, left_result.rest().size() != str.size());
                 }
-                T result = elem_result.value();
-                str = elem_result.rest();
-                auto right_result = right_parser.parse(str);
+                auto right_result = step(right_parser, elem_result.rest());
                 if (!right_result) {
-                    return nullres<T>(right_result.get_message());
+                    return propagate<R>(right_result, elem_result.rest().size() != str.size());
                 }
-                return Result<T>{result, right_result.rest()};
+                return Result<R, In>{std::move(elem_result.value()), right_result.rest()};
             }
-        private:
-            Parser<T> elem_parser;
-            Parser<BL> left_parser;
-            Parser<BR> right_parser;
+
+            Parser<T, In> elem_parser;
+            Parser<BL, In> left_parser;
+            Parser<BR, In> right_parser;
         };
 
         // wrap pair<vector, vector> for SeqSaver
@@ -307,62 +1413,86 @@ namespace Parsec {
             SeqWithSeps(std::vector<T> elems_, std::vector<U> seps_)
                 : ielems(std::move(elems_)), iseps(std::move(seps_)) {}
 
-            std::vector<T> elems() { return ielems; }
-            std::vector<U> seps() { return iseps; }
+            const std::vector<T>& elems() const { return ielems; }
+            const std::vector<U>& seps() const { return iseps; }
         private:
             std::vector<T> ielems;
             std::vector<U> iseps;
         };
 
         // like ISeqParser but save separators too
-        template<typename T, typename U>
-        struct ISeqSaverParser : IParser<SeqWithSeps<T, U>> {
-            explicit ISeqSaverParser(Parser<T> elem_parser_, Parser<U> sep_parser_)
+        template<typename T, typename U, typename In>
+        struct ISeqSaverParser : IParser<SeqWithSeps<T, U>, In> {
+            explicit ISeqSaverParser(Parser<T, In> elem_parser_, Parser<U, In> sep_parser_)
                     : elem_parser(elem_parser_), sep_parser(sep_parser_) {}
 
-            Result<SeqWithSeps<T, U>> parse(std::string_view str) override {
+            Result<SeqWithSeps<T, U>, In> parse(In str) const override {
                 auto head = elem_parser.parse(str);
                 if (!head) {
-                    return nullres<SeqWithSeps<T, U>>(head.get_message());
+                    return propagate<SeqWithSeps<T, U>>(head);
                 }
                 std::vector<T> results = {head.value()};
                 std::vector<U> seps;
                 str = head.rest();
                 while (true) {
+                    charge();
                     auto sep_result = sep_parser.parse(str);
                     if (!sep_result) {
+                        if (sep_result.consumed()) {
+                            return propagate<SeqWithSeps<T, U>>(sep_result);
+                        }
                         break;
                     }
                     auto elem_result = elem_parser.parse(sep_result.rest());
                     if (!elem_result) {
+                        bool sep_consumed = sep_result.rest().size() != str.size();
+                        if (sep_consumed || elem_result.consumed()) {
+                            return propagate<SeqWithSeps<T, U>>(elem_result, sep_consumed);
+                        }
                         break;
                     }
                     str = elem_result.rest();
-                    results.push_back(elem_result.value());
-                    seps.push_back(sep_result.value());
+                    results.push_back(std::move(elem_result.value()));
+                    seps.push_back(std::move(sep_result.value()));
                 }
-                while (seps.size() + 1 > results.size()) {
-                    seps.pop_back();
+                return Result<SeqWithSeps<T, U>, In>{SeqWithSeps(std::move(results), std::move(seps)), str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_seq_of(elem_parser, sep_parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(elem_parser);
+                alphabet.add(sep_parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(elem_parser);
+                if (first.nullable) {
+                    First sep = sets.of(sep_parser);
+                    sep.nullable = true;
+                    first |= sep;
                 }
-                return Result<SeqWithSeps<T, U>>{SeqWithSeps(results, seps), str};
+                return first;
             }
         private:
-            Parser<T> elem_parser;
-            Parser<U> sep_parser;
+            Parser<T, In> elem_parser;
+            Parser<U, In> sep_parser;
         };
 
-        template<typename T, typename U>
-        struct IFoldParser : IParser<T> {
-            explicit IFoldParser(Parser<SeqWithSeps<T, U>> parser_, std::vector<std::pair<U, std::function<T(T, T)>>> operators_)
+        template<typename T, typename U, typename In>
+        struct IFoldParser : IParser<T, In> {
+            explicit IFoldParser(Parser<SeqWithSeps<T, U>, In> parser_, std::vector<std::pair<U, std::function<T(T, T)>>> operators_)
             : parser(parser_), operators(operators_) {}
 
-            Result<T> parse(std::string_view str) override {
+            Result<T, In> parse(In str) const override {
                 auto result = parser.parse(str);
                 if (!result) {
-                    return nullres<T>(result.get_message());
+                    return propagate<T>(result);
                 }
-                auto elements = result.value().elems();
-                auto seps = result.value().seps();
+                const auto& elements = result.value().elems();
+                const auto& seps = result.value().seps();
                 T t_result = elements[0];
                 for (std::size_t i = 1; i < elements.size(); ++i) {
                     for (const auto& [op, func] : operators) {
@@ -372,70 +1502,540 @@ namespace Parsec {
                         }
                     }
                 }
-                return Result<T>{t_result, result.rest()};
+                return Result<T, In>{t_result, result.rest()};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return parser.skip(str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.of(parser);
+            }
+        private:
+            Parser<SeqWithSeps<T, U>, In> parser;
+            std::vector<std::pair<U, std::function<T(T, T)>>> operators;
+        };
+
+        // fold(seq_save(elem, sep), operators) without the vectors: elements are folded as soon as
+        // they are parsed, consumed failures are the same as of ISeqSaverParser
+        template<typename T, typename U, typename In>
+        struct IChainLeftParser : IParser<T, In> {
+            explicit IChainLeftParser(Parser<T, In> elem_parser_, Parser<U, In> sep_parser_,
+                                      std::vector<std::pair<U, std::function<T(T, T)>>> operators_)
+                : elem_parser(elem_parser_), sep_parser(sep_parser_), operators(std::move(operators_)) {}
+
+            Result<T, In> parse(In str) const override {
+                auto head = elem_parser.parse(str);
+                if (!head) {
+                    return propagate<T>(head);
+                }
+                T acc = std::move(head.value());
+                str = head.rest();
+                while (true) {
+                    charge();
+                    auto sep_result = sep_parser.parse(str);
+                    if (!sep_result) {
+                        if (sep_result.consumed()) {
+                            return propagate<T>(sep_result);
+                        }
+                        break;
+                    }
+                    auto elem_result = elem_parser.parse(sep_result.rest());
+                    if (!elem_result) {
+                        bool sep_consumed = sep_result.rest().size() != str.size();
+                        if (sep_consumed || elem_result.consumed()) {
+                            return propagate<T>(elem_result, sep_consumed);
+                        }
+                        break;
+                    }
+                    str = elem_result.rest();
+                    for (const auto& [op, func] : operators) {
+                        if (op == sep_result.value()) {
+                            acc = func(std::move(acc), std::move(elem_result.value()));
+                            break;
+                        }
+                    }
+                }
+                return Result<T, In>{std::move(acc), str};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return skip_seq_of(elem_parser, sep_parser, str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(elem_parser);
+                alphabet.add(sep_parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(elem_parser);
+                if (first.nullable) {
+                    First sep = sets.of(sep_parser);
+                    sep.nullable = true;
+                    first |= sep;
+                }
+                return first;
             }
         private:
-            Parser<SeqWithSeps<T, U>> parser;
+            Parser<T, In> elem_parser;
+            Parser<U, In> sep_parser;
             std::vector<std::pair<U, std::function<T(T, T)>>> operators;
         };
 
-        template<typename T>
-        struct IIdParser : IParser<T> {
+        template<typename T, typename In>
+        struct IIdParser : IParser<T, In> {
             explicit IIdParser(T val_) : val(val_) {}
 
-            Result<T> parse(std::string_view str) override {
-                return Result<T>(val, str);
+            Result<T, In> parse(In str) const override {
+                return Result<T, In>(val, str);
+            }
+
+            Skipped<In> skip(In str) const override {
+                return Skipped<In>{std::monostate{}, str};
+            }
+
+            void collect(Alphabet&) const override {}
+
+            First first(FirstSets&) const override {
+                First first;
+                first.nullable = true;
+                return first;
             }
         private:
             T val;
         };
 
-        template<typename T, typename R, typename Func>
-        struct IFMapParser : IParser<R> {
-            explicit IFMapParser(Parser<T> parser_, Func f_)
+        template<typename T, typename R, typename Func, typename In>
+        struct IFMapParser : IParser<R, In> {
+            explicit IFMapParser(Parser<T, In> parser_, Func f_)
                     : parser(parser_), f(f_) {}
 
-            Result<R> parse(std::string_view str) override {
+            Result<R, In> parse(In str) const override {
                 auto result = parser.parse(str);
                 if (!result) {
-                    return nullres<R>(result.get_message());
+                    return propagate<R>(result);
                 }
-                return Result<R>{f(result.value()), result.rest()};
+                return Result<R, In>{f(result.value()), result.rest()};
+            }
+
+            Skipped<In> skip(In str) const override {
+                return parser.skip(str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.of(parser);
             }
         private:
-            Parser<T> parser;
+            Parser<T, In> parser;
             Func f;
         };
 
-        template<typename T>
-        struct ILazyParser : IParser<T> {
-            explicit ILazyParser(std::function<Parser<T>()> get_parser_)
-                    : get_parser(std::move(get_parser_)) {}
+        // Builds its target once, on first use or when the owning arena resolves rules.
+        // A plain function builder is a rule and resolves to the arena-wide memoised graph.
+        template<typename T, typename In>
+        struct ILazyParser : IParser<T, In>, ILazyNode {
+            explicit ILazyParser(Arena* owner_, Parser<T, In> (*rule_)())
+                    : owner(owner_), rule(rule_) {}
+
+            explicit ILazyParser(Arena* owner_, std::function<Parser<T, In>()> get_parser_)
+                    : owner(owner_), get_parser(std::move(get_parser_)) {}
+
+            Result<T, In> parse(In str) const override {
+                charge();
+                return resolved()->parse(str);
+            }
+
+            Skipped<In> skip(In str) const override {
+                charge();
+                return resolved()->skip(str);
+            }
+
+            void resolve() const override {
+                if (target.load(std::memory_order_acquire)) {
+                    return;
+                }
+                IParser<T, In>* parser = rule ? owner->rule(rule) : owner->build(get_parser);
+                IParser<T, In>* expected = nullptr;
+                target.compare_exchange_strong(expected, parser, std::memory_order_acq_rel);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                resolve();
+                alphabet.add(target.load(std::memory_order_acquire));
+            }
 
-            Result<T> parse(std::string_view str) override {
-                return get_parser().parse(str);
+            First first(FirstSets& sets) const override {
+                resolve();
+                return sets.of(target.load(std::memory_order_acquire));
             }
         private:
-            std::function<Parser<T>()> get_parser;
+            IParser<T, In>* resolved() const {
+                IParser<T, In>* parser = target.load(std::memory_order_acquire);
+                if (!parser) {
+                    resolve();
+                    parser = target.load(std::memory_order_acquire);
+                }
+                return parser;
+            }
+
+            Arena* owner;
+            Parser<T, In> (*rule)() = nullptr;
+            std::function<Parser<T, In>()> get_parser;
+            mutable std::atomic<IParser<T, In>*> target = nullptr;
         };
 
-        template<typename T>
-        struct IMaybeParser : IParser<T> {
-            explicit IMaybeParser(Parser<T> parser_, T default_value_)
+        template<typename T, typename In>
+        struct IMaybeParser : IParser<T, In> {
+            explicit IMaybeParser(Parser<T, In> parser_, T default_value_)
                     : parser(parser_), default_value(default_value_) {}
 
-            Result<T> parse(std::string_view str) override {
+            Result<T, In> parse(In str) const override {
                 auto result = parser.parse(str);
-                if (!result) {
-                    return Result<T>{default_value, str};
+                if (!result && !result.consumed()) {
+                    return Result<T, In>{default_value, str};
+                }
+                return result;
+            }
+
+            Skipped<In> skip(In str) const override {
+                auto result = parser.skip(str);
+                if (!result && !result.consumed()) {
+                    return Skipped<In>{std::monostate{}, str};
                 }
                 return result;
             }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                first.nullable = true;
+                return first;
+            }
         private:
-            Parser<T> parser;
+            Parser<T, In> parser;
             T default_value;
         };
 
+        // failure of parser is reported as not consumed, so alternatives backtrack over it
+        template<typename T, typename In>
+        struct ITryParser : IParser<T, In> {
+            explicit ITryParser(Parser<T, In> parser_) : parser(std::move(parser_)) {}
+
+            Result<T, In> parse(In str) const override {
+                auto result = parser.parse(str);
+                result.set_consumed(false);
+                return result;
+            }
+
+            Skipped<In> skip(In str) const override {
+                auto result = parser.skip(str);
+                result.set_consumed(false);
+                return result;
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.of(parser);
+            }
+        private:
+            Parser<T, In> parser;
+        };
+
+        // failure of parser is reported as consumed even if it consumed nothing
+        template<typename T, typename In>
+        struct ICutParser : IParser<T, In> {
+            explicit ICutParser(Parser<T, In> parser_) : parser(std::move(parser_)) {}
+
+            Result<T, In> parse(In str) const override {
+                auto result = parser.parse(str);
+                if (!result) {
+                    result.set_consumed(true);
+                }
+                return result;
+            }
+
+            Skipped<In> skip(In str) const override {
+                auto result = parser.skip(str);
+                if (!result) {
+                    result.set_consumed(true);
+                }
+                return result;
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            // first() stays unknown: the failure is consumed even if nothing was consumed
+        private:
+            Parser<T, In> parser;
+        };
+
+        // recognises what parser does without building its value, see IParser::skip
+        template<typename T, typename In>
+        struct IDiscardParser : IParser<std::monostate, In> {
+            explicit IDiscardParser(Parser<T, In> parser_) : parser(std::move(parser_)) {}
+
+            Result<std::monostate, In> parse(In str) const override {
+                return parser.skip(str);
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                return sets.of(parser);
+            }
+
+            std::optional<char> single_char() const override {
+                return parser.node()->single_char();
+            }
+        private:
+            Parser<T, In> parser;
+        };
+
+        // fails if parser succeeds without consuming input
+        template<typename T, typename In>
+        struct IConsumesParser : IParser<T, In> {
+            explicit IConsumesParser(Parser<T, In> parser_) : parser(std::move(parser_)) {}
+
+            Result<T, In> parse(In str) const override {
+                auto result = parser.parse(str);
+                if (result && result.rest().size() == str.size()) {
+                    return nullres<T, In>("Expected not empty match.");
+                }
+                return result;
+            }
+
+            Skipped<In> skip(In str) const override {
+                auto result = parser.skip(str);
+                if (result && result.rest().size() == str.size()) {
+                    return nullres<std::monostate, In>("Expected not empty match.");
+                }
+                return result;
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                alphabet.add(parser);
+            }
+
+            First first(FirstSets& sets) const override {
+                First first = sets.of(parser);
+                first.nullable = false;
+                return first;
+            }
+        private:
+            Parser<T, In> parser;
+        };
+
+        // Alternation of branches which never succeed on the same input, so they may be tried
+        // in any order: the branch which succeeds most often is moved to the front about every
+        // period successes. Successes are sampled (see count), so parses sharing the node seldom
+        // write to it and the graph stays read-mostly across threads. Disjointness is proven from
+        // First sets once the graph is complete: no branch may succeed without consuming input and
+        // no two branches share a first char. Otherwise the given order is kept. Results, rest and
+        // messages do not depend on the order.
+        template<typename T, typename In>
+        struct IAdaptiveAlternativeParser : IParser<T, In>, ILazyNode, IProfiledNode {
+            static constexpr std::size_t max_branches = 16;
+            // one success in sample_rate is counted, with the weight of sample_rate
+            static constexpr std::uint32_t sample_rate = 32;
+
+            explicit IAdaptiveAlternativeParser(std::string name_, std::vector<Parser<T, In>> branches_,
+                                                std::uint64_t period_)
+                : profile_name(std::move(name_)), branches(std::move(branches_)),
+                  period(std::max<std::uint64_t>(period_, 1)),
+                  decay_period(period > std::numeric_limits<std::uint64_t>::max() / sample_rate
+                               ? std::numeric_limits<std::uint64_t>::max() : period * sample_rate),
+                  hits(branches.size()) {
+                std::array<std::uint8_t, max_branches> identity{};
+                for (std::size_t i = 0; i < branches.size(); ++i) {
+                    identity[i] = static_cast<std::uint8_t>(i);
+                }
+                packed_order.store(pack(identity), std::memory_order_relaxed);
+            }
+
+            Result<T, In> parse(In str) const override {
+                return attempt<T>(str, [](const Parser<T, In>& branch, In s) { return branch.parse(s); });
+            }
+
+            Skipped<In> skip(In str) const override {
+                return attempt<std::monostate>(str, [](const Parser<T, In>& branch, In s) { return branch.skip(s); });
+            }
+
+            void resolve() const override {
+                std::call_once(resolved, [this] {
+                    FirstSets sets;
+                    std::bitset<256> seen;
+                    bool proven = true;
+                    for (const auto& branch : branches) {
+                        First first = sets.of(branch);
+                        proven = proven && !first.any && !first.nullable && (first.chars & seen).none();
+                        seen |= first.chars;
+                    }
+                    disjoint = proven;
+                });
+            }
+
+            void collect(Alphabet& alphabet) const override {
+                for (const auto& branch : branches) {
+                    alphabet.add(branch);
+                }
+            }
+
+            First first(FirstSets& sets) const override {
+                First first;
+                for (const auto& branch : branches) {
+                    first |= sets.of(branch);
+                }
+                return first;
+            }
+
+            const std::string& name() const override {
+                return profile_name;
+            }
+
+            std::vector<std::size_t> order() const override {
+                std::uint64_t order = packed_order.load(std::memory_order_relaxed);
+                std::vector<std::size_t> result;
+                for (std::size_t i = 0; i < branches.size(); ++i, order >>= 4) {
+                    result.push_back(order & 0xF);
+                }
+                return result;
+            }
+
+            // accepts a permutation of the branches if they are proven to be disjoint
+            bool set_order(const std::vector<std::size_t>& order) const override {
+                resolve();
+                if (!disjoint || order.size() != branches.size()) {
+                    return false;
+                }
+                std::array<std::uint8_t, max_branches> unpacked{};
+                std::bitset<max_branches> used;
+                for (std::size_t i = 0; i < order.size(); ++i) {
+                    if (order[i] >= branches.size() || used[order[i]]) {
+                        return false;
+                    }
+                    used.set(order[i]);
+                    unpacked[i] = static_cast<std::uint8_t>(order[i]);
+                }
+                packed_order.store(pack(unpacked), std::memory_order_relaxed);
+                return true;
+            }
+
+        private:
+            // tries the branches in the learned order, step parses or skips one of them
+            template<typename R, typename Step>
+            Result<R, In> attempt(In str, Step step) const {
+                charge();
+                resolve();
+                std::uint64_t order = packed_order.load(std::memory_order_relaxed);
+                // when every branch fails, the message is the one of the last declared branch,
+                // as of a chain of '|', whatever the learned order is
+                Result<R, In> failure;
+                for (std::size_t i = 0; i < branches.size(); ++i, order >>= 4) {
+                    std::size_t branch = order & 0xF;
+                    Result<R, In> result = step(branches[branch], str);
+                    if (result) {
+                        if (disjoint) {
+                            count(branch);
+                        }
+                        return result;
+                    }
+                    if (result.consumed()) {
+                        return result;
+                    }
+                    if (branch + 1 == branches.size()) {
+                        failure = result;
+                    }
+                }
+                return failure;
+            }
+
+            // branch tried i-th is kept in bits [4 * i, 4 * i + 4), so the order is read and
+            // replaced at once by concurrent parses
+            std::uint64_t pack(const std::array<std::uint8_t, max_branches>& order) const {
+                std::uint64_t packed = 0;
+                for (std::size_t i = branches.size(); i-- > 0;) {
+                    packed = (packed << 4) | order[i];
+                }
+                return packed;
+            }
+
+            void count(std::size_t branch) const {
+                // xorshift of the thread instead of a fixed stride, which would keep sampling
+                // the same branch of periodic input; the counters are shared, the dice are not
+                thread_local std::uint32_t dice = 2463534242u;
+                dice ^= dice << 13;
+                dice ^= dice >> 17;
+                dice ^= dice << 5;
+                if (dice % sample_rate != 0) {
+                    return;
+                }
+                hits[branch].fetch_add(sample_rate, std::memory_order_relaxed);
+                std::uint64_t before = calls.fetch_add(sample_rate, std::memory_order_relaxed);
+                std::uint64_t after = before + sample_rate;
+                if (before / period != after / period) {
+                    // counts are halved once they hold about period samples, not period weighted
+                    // successes: a window of period / sample_rate samples would be mostly noise
+                    reorder(before / decay_period != after / decay_period);
+                }
+            }
+
+            void reorder(bool decay) const {
+                std::array<std::uint64_t, max_branches> counts{};
+                for (std::size_t i = 0; i < branches.size(); ++i) {
+                    counts[i] = hits[i].load(std::memory_order_relaxed);
+                }
+                std::array<std::uint8_t, max_branches> order{};
+                std::uint64_t packed = packed_order.load(std::memory_order_relaxed);
+                for (std::size_t i = 0; i < branches.size(); ++i, packed >>= 4) {
+                    order[i] = packed & 0xF;
+                }
+                // stable insertion sort: std::stable_sort may allocate a buffer inside a parse
+                for (std::size_t i = 1; i < branches.size(); ++i) {
+                    for (std::size_t j = i; j > 0 && counts[order[j]] > counts[order[j - 1]]; --j) {
+                        std::swap(order[j], order[j - 1]);
+                    }
+                }
+                packed_order.store(pack(order), std::memory_order_relaxed);
+                if (!decay) {
+                    return;
+                }
+                // older traffic weighs less, so the order follows changes of the input
+                for (std::size_t i = 0; i < branches.size(); ++i) {
+                    hits[i].fetch_sub(counts[i] / 2, std::memory_order_relaxed);
+                }
+            }
+
+            std::string profile_name;
+            std::vector<Parser<T, In>> branches;
+            std::uint64_t period;
+            std::uint64_t decay_period;
+            mutable std::vector<std::atomic<std::uint64_t>> hits;
+            mutable std::atomic<std::uint64_t> calls = 0;
+            mutable std::atomic<std::uint64_t> packed_order = 0;
+            mutable std::once_flag resolved;
+            mutable bool disjoint = false;
+        };
+
     } // namespace Internal
 
 } // namespace Parsec
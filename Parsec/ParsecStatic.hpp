@@ -0,0 +1,502 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace Parsec::Static {
+
+    // Value-type counterparts of the Parsec combinators. Every parser is a literal type with
+    // a constexpr parse, so grammars and tables built from them are evaluated at compile time:
+    //     static_assert(token('I').parse("I  ").rest.empty());
+    // The subset works on std::string_view only, does not produce error messages
+    // and its alternatives always backtrack (there is no try_ / cut).
+    // Recursive grammars are written as parse functions and referenced with rule<f>().
+
+    template<typename T>
+    struct Result {
+        using value_type = T;
+
+        bool ok = false;
+        T value{};
+        std::string_view rest;
+
+        constexpr explicit operator bool() const { return ok; }
+    };
+
+    template<typename T>
+    constexpr Result<T> success(T value, std::string_view rest) {
+        return Result<T>{true, std::move(value), rest};
+    }
+
+    template<typename T>
+    constexpr Result<T> failure() {
+        return Result<T>{};
+    }
+
+    // every static parser derives from Base
+    struct Base {};
+
+    template<typename P>
+    concept StaticParser = std::is_base_of_v<Base, P>;
+
+    template<StaticParser P>
+    using value_t = typename P::value_type;
+
+    // set of chars as a table indexed by the char
+    struct CharClass {
+        std::array<bool, 256> table{};
+
+        constexpr CharClass() = default;
+        constexpr explicit CharClass(std::string_view chars) {
+            for (char c : chars) {
+                table[static_cast<unsigned char>(c)] = true;
+            }
+        }
+
+        constexpr bool contains(char c) const {
+            return table[static_cast<unsigned char>(c)];
+        }
+
+        constexpr CharClass operator|(const CharClass& other) const {
+            CharClass result;
+            for (std::size_t i = 0; i < table.size(); ++i) {
+                result.table[i] = table[i] || other.table[i];
+            }
+            return result;
+        }
+    };
+
+    struct Char : Base {
+        using value_type = char;
+
+        constexpr explicit Char(char target_) : target(target_) {}
+
+        constexpr Result<char> parse(std::string_view str) const {
+            if (str.empty() || str[0] != target) {
+                return failure<char>();
+            }
+            return success(target, str.substr(1));
+        }
+
+        char target;
+    };
+
+    struct Chars : Base {
+        using value_type = char;
+
+        constexpr explicit Chars(CharClass targets_) : targets(targets_) {}
+
+        constexpr Result<char> parse(std::string_view str) const {
+            if (str.empty() || !targets.contains(str[0])) {
+                return failure<char>();
+            }
+            return success(str[0], str.substr(1));
+        }
+
+        CharClass targets;
+    };
+
+    struct Prefix : Base {
+        using value_type = std::string_view;
+
+        constexpr explicit Prefix(std::string_view target_) : target(target_) {}
+
+        constexpr Result<std::string_view> parse(std::string_view str) const {
+            if (!str.starts_with(target)) {
+                return failure<std::string_view>();
+            }
+            return success(target, str.substr(target.size()));
+        }
+
+        std::string_view target;
+    };
+
+    // Longest of a fixed set of literals, stored as a trie in a flat array of Nodes nodes.
+    // Returns the value attached to the literal.
+    template<typename T, std::size_t Nodes>
+    struct Literals : Base {
+        using value_type = T;
+
+        struct Node {
+            char c = 0;
+            int child = -1;
+            int sibling = -1;
+            bool terminal = false;
+            T value{};
+        };
+
+        constexpr explicit Literals(std::initializer_list<std::pair<std::string_view, T>> literals) {
+            for (const auto& [literal, value] : literals) {
+                int node = 0;
+                for (char c : literal) {
+                    int next = nodes[node].child;
+                    while (next != -1 && nodes[next].c != c) {
+                        next = nodes[next].sibling;
+                    }
+                    if (next == -1) {
+                        if (used == Nodes) {
+                            throw std::length_error("Literals: not enough nodes");
+                        }
+                        next = static_cast<int>(used++);
+                        nodes[next].c = c;
+                        nodes[next].sibling = nodes[node].child;
+                        nodes[node].child = next;
+                    }
+                    node = next;
+                }
+                nodes[node].terminal = true;
+                nodes[node].value = value;
+            }
+        }
+
+        constexpr Result<T> parse(std::string_view str) const {
+            Result<T> best = failure<T>();
+            int node = 0;
+            for (std::size_t i = 0; i < str.size(); ++i) {
+                int next = nodes[node].child;
+                while (next != -1 && nodes[next].c != str[i]) {
+                    next = nodes[next].sibling;
+                }
+                if (next == -1) {
+                    break;
+                }
+                node = next;
+                if (nodes[node].terminal) {
+                    best = success(nodes[node].value, str.substr(i + 1));
+                }
+            }
+            return best;
+        }
+
+        std::array<Node, Nodes> nodes{};
+        std::size_t used = 1;
+    };
+
+    template<typename T>
+    struct Id : Base {
+        using value_type = T;
+
+        constexpr explicit Id(T value_) : value(std::move(value_)) {}
+
+        constexpr Result<T> parse(std::string_view str) const {
+            return success(value, str);
+        }
+
+        T value;
+    };
+
+    template<StaticParser P1, StaticParser P2>
+    struct Alt : Base {
+        static_assert(std::is_same_v<value_t<P1>, value_t<P2>>, "alternatives must have the same value type");
+        using value_type = value_t<P1>;
+
+        constexpr Alt(P1 fst_, P2 snd_) : fst(std::move(fst_)), snd(std::move(snd_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto fst_result = fst.parse(str);
+            if (fst_result) {
+                return fst_result;
+            }
+            return snd.parse(str);
+        }
+
+        P1 fst;
+        P2 snd;
+    };
+
+    template<StaticParser P1, StaticParser P2>
+    struct Skip : Base {
+        using value_type = value_t<P2>;
+
+        constexpr Skip(P1 skip_parser_, P2 parser_) : skip_parser(std::move(skip_parser_)), parser(std::move(parser_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto skip_result = skip_parser.parse(str);
+            if (!skip_result) {
+                return failure<value_type>();
+            }
+            return parser.parse(skip_result.rest);
+        }
+
+        P1 skip_parser;
+        P2 parser;
+    };
+
+    template<StaticParser P, typename Func>
+    struct Map : Base {
+        using value_type = std::invoke_result_t<const Func&, value_t<P>>;
+
+        constexpr Map(P parser_, Func f_) : parser(std::move(parser_)), f(std::move(f_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto result = parser.parse(str);
+            if (!result) {
+                return failure<value_type>();
+            }
+            return success(f(result.value), result.rest);
+        }
+
+        P parser;
+        Func f;
+    };
+
+    template<StaticParser P1, StaticParser P2, typename Func>
+    struct Merge : Base {
+        using value_type = std::invoke_result_t<const Func&, value_t<P1>, value_t<P2>>;
+
+        constexpr Merge(P1 p1_, P2 p2_, Func f_) : p1(std::move(p1_)), p2(std::move(p2_)), f(std::move(f_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto res1 = p1.parse(str);
+            if (!res1) {
+                return failure<value_type>();
+            }
+            auto res2 = p2.parse(res1.rest);
+            if (!res2) {
+                return failure<value_type>();
+            }
+            return success(f(res1.value, res2.value), res2.rest);
+        }
+
+        P1 p1;
+        P2 p2;
+        Func f;
+    };
+
+    template<StaticParser P>
+    struct Ban : Base {
+        using value_type = value_t<P>;
+
+        constexpr Ban(P parser_, value_type ban_value_) : parser(std::move(parser_)), ban_value(std::move(ban_value_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto result = parser.parse(str);
+            if (!result || result.value == ban_value) {
+                return failure<value_type>();
+            }
+            return result;
+        }
+
+        P parser;
+        value_type ban_value;
+    };
+
+    template<StaticParser P>
+    struct CountMany : Base {
+        using value_type = std::size_t;
+
+        constexpr explicit CountMany(P parser_) : parser(std::move(parser_)) {}
+
+        constexpr Result<std::size_t> parse(std::string_view str) const {
+            std::size_t count = 0;
+            while (true) {
+                auto result = parser.parse(str);
+                if (!result) {
+                    break;
+                }
+                ++count;
+                str = result.rest;
+            }
+            return success(count, str);
+        }
+
+        P parser;
+    };
+
+    struct Spaces : Base {
+        using value_type = char;
+
+        constexpr Result<char> parse(std::string_view str) const {
+            char first = !str.empty() && is_space(str[0]) ? str[0] : 0;
+            return success(first, skip(str));
+        }
+
+        static constexpr bool is_space(char c) {
+            return c == ' ' || c == '\t';
+        }
+
+        static constexpr std::string_view skip(std::string_view str) {
+            std::size_t i = 0;
+            while (i < str.size() && is_space(str[i])) {
+                ++i;
+            }
+            return str.substr(i);
+        }
+    };
+
+    template<StaticParser P>
+    struct Lexeme : Base {
+        using value_type = value_t<P>;
+
+        constexpr explicit Lexeme(P parser_) : parser(std::move(parser_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto result = parser.parse(str);
+            if (!result) {
+                return result;
+            }
+            return success(result.value, Spaces::skip(result.rest));
+        }
+
+        P parser;
+    };
+
+    template<StaticParser P, StaticParser BL, StaticParser BR>
+    struct Brackets : Base {
+        using value_type = value_t<P>;
+
+        constexpr Brackets(BL left_parser_, P elem_parser_, BR right_parser_)
+            : left_parser(std::move(left_parser_)), elem_parser(std::move(elem_parser_)), right_parser(std::move(right_parser_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto left_result = left_parser.parse(str);
+            if (!left_result) {
+                return failure<value_type>();
+            }
+            auto elem_result = elem_parser.parse(left_result.rest);
+            if (!elem_result) {
+                return failure<value_type>();
+            }
+            auto right_result = right_parser.parse(elem_result.rest);
+            if (!right_result) {
+                return failure<value_type>();
+            }
+            return success(elem_result.value, right_result.rest);
+        }
+
+        BL left_parser;
+        P elem_parser;
+        BR right_parser;
+    };
+
+    // fold(seq_save(elem, sep), ...) without the vectors: acc = f(acc, sep, elem) left to right
+    template<StaticParser P, StaticParser S, typename Func>
+    struct ChainLeft : Base {
+        using value_type = value_t<P>;
+
+        constexpr ChainLeft(P elem_parser_, S sep_parser_, Func f_)
+            : elem_parser(std::move(elem_parser_)), sep_parser(std::move(sep_parser_)), f(std::move(f_)) {}
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            auto head = elem_parser.parse(str);
+            if (!head) {
+                return head;
+            }
+            value_type acc = head.value;
+            str = head.rest;
+            while (true) {
+                auto sep_result = sep_parser.parse(str);
+                if (!sep_result) {
+                    break;
+                }
+                auto elem_result = elem_parser.parse(sep_result.rest);
+                if (!elem_result) {
+                    break;
+                }
+                acc = f(acc, sep_result.value, elem_result.value);
+                str = elem_result.rest;
+            }
+            return success(acc, str);
+        }
+
+        P elem_parser;
+        S sep_parser;
+        Func f;
+    };
+
+    // parser defined by a function constexpr Result<T> f(std::string_view), may be recursive
+    template<auto F>
+    struct Rule : Base {
+        using value_type = typename decltype(F(std::string_view{}))::value_type;
+
+        constexpr Result<value_type> parse(std::string_view str) const {
+            return F(str);
+        }
+    };
+
+    template<StaticParser P1, StaticParser P2>
+    constexpr Alt<P1, P2> operator|(P1 alt1, P2 alt2) {
+        return Alt<P1, P2>(std::move(alt1), std::move(alt2));
+    }
+
+    template<StaticParser P1, StaticParser P2>
+    constexpr Skip<P1, P2> operator>>(P1 skip_parser, P2 parser) {
+        return Skip<P1, P2>(std::move(skip_parser), std::move(parser));
+    }
+
+    constexpr Char char_parser(char c) {
+        return Char(c);
+    }
+
+    constexpr Chars chars_alt_parser(CharClass chars) {
+        return Chars(chars);
+    }
+
+    constexpr Prefix prefix_parser(std::string_view str) {
+        return Prefix(str);
+    }
+
+    template<typename T, std::size_t Nodes>
+    constexpr Literals<T, Nodes> literals_parser(std::initializer_list<std::pair<std::string_view, T>> literals) {
+        return Literals<T, Nodes>(literals);
+    }
+
+    template<typename T>
+    constexpr Id<T> id_parser(T id_value) {
+        return Id<T>(std::move(id_value));
+    }
+
+    template<StaticParser P, typename Func>
+    constexpr Map<P, Func> map_parser(P parser, Func f) {
+        return Map<P, Func>(std::move(parser), std::move(f));
+    }
+
+    template<StaticParser P1, StaticParser P2, typename Func>
+    constexpr Merge<P1, P2, Func> merge_parser(P1 p1, P2 p2, Func f) {
+        return Merge<P1, P2, Func>(std::move(p1), std::move(p2), std::move(f));
+    }
+
+    template<StaticParser P>
+    constexpr Ban<P> if_equal_not_parsed(P parser, value_t<P> ban_value) {
+        return Ban<P>(std::move(parser), std::move(ban_value));
+    }
+
+    template<StaticParser P>
+    constexpr CountMany<P> count_many(P parser) {
+        return CountMany<P>(std::move(parser));
+    }
+
+    constexpr Spaces spaces() {
+        return Spaces();
+    }
+
+    template<StaticParser P>
+    constexpr Lexeme<P> lexeme(P parser) {
+        return Lexeme<P>(std::move(parser));
+    }
+
+    constexpr Lexeme<Char> token(char c) {
+        return lexeme(char_parser(c));
+    }
+
+    template<StaticParser P, StaticParser BL, StaticParser BR>
+    constexpr Brackets<P, BL, BR> brackets_parser(BL left_parser, P elem_parser, BR right_parser) {
+        return Brackets<P, BL, BR>(std::move(left_parser), std::move(elem_parser), std::move(right_parser));
+    }
+
+    template<StaticParser P, StaticParser S, typename Func>
+    constexpr ChainLeft<P, S, Func> chain_left(P elem_parser, S sep_parser, Func f) {
+        return ChainLeft<P, S, Func>(std::move(elem_parser), std::move(sep_parser), std::move(f));
+    }
+
+    template<auto F>
+    constexpr Rule<F> rule() {
+        return Rule<F>();
+    }
+
+} // namespace Parsec::Static
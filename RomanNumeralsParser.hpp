@@ -2,6 +2,7 @@
 
 #include <sstream>
 #include <cmath>
+#include <functional>
 
 #include "Parsec/Parsec.hpp"
 
@@ -13,96 +14,98 @@ namespace CalcParser::Internal {
 
         using std::int64_t;
 
-        Parser<int64_t> roman_numeral_zero() {
+        inline Parser<int64_t> roman_numeral_zero() {
             return fmap_parser<char, int64_t>(char_parser('Z'), [](char) { return 0; });
         }
 
-        Parser<int64_t> roman_numeral_terminal() {
+        inline Parser<int64_t> roman_numeral_terminal() {
             return id_parser<int64_t>(0);
         }
 
-        Parser<int64_t> roman_numeral_1() { // 1-3 repeats
+        inline Parser<int64_t> roman_numeral_1() { // 1-3 repeats
             return map_parser(prefix_parser("III") >> roman_numeral_terminal(), [](int64_t a) { return a + 3; })
                  | map_parser(prefix_parser("II")  >> roman_numeral_terminal(), [](int64_t a) { return a + 2; })
                  | map_parser(prefix_parser("I")   >> roman_numeral_terminal(), [](int64_t a) { return a + 1; })
                  | roman_numeral_terminal();
         }
 
-        Parser<int64_t> roman_numeral_4() { // only 1 repeats
-            return map_parser(prefix_parser("IV") >> roman_numeral_1(), [](int64_t a) { return a + 4; })
-                 | roman_numeral_1();
+        // младшие разряды подключаются через rule_parser: каждый билдер выполняется один раз на арену,
+        // а не 2-4 раза на каждый вызов старшего, из-за чего граф рос экспоненциально
+        inline Parser<int64_t> roman_numeral_4() { // only 1 repeats
+            return map_parser(prefix_parser("IV") >> rule_parser(roman_numeral_1), [](int64_t a) { return a + 4; })
+                 | rule_parser(roman_numeral_1);
         }
 
-        Parser<int64_t> roman_numeral_5() { // only 1 repeats
-            return map_parser(char_parser('V') >> roman_numeral_4(), [](int64_t a) { return a + 5; })
-                 | roman_numeral_4();
+        inline Parser<int64_t> roman_numeral_5() { // only 1 repeats
+            return map_parser(char_parser('V') >> rule_parser(roman_numeral_4), [](int64_t a) { return a + 5; })
+                 | rule_parser(roman_numeral_4);
         }
 
-        Parser<int64_t> roman_numeral_9() { // only 1 repeats
-            return map_parser(prefix_parser("IX") >> roman_numeral_5(), [](int64_t a) { return a + 9; })
-                 | roman_numeral_5();
+        inline Parser<int64_t> roman_numeral_9() { // only 1 repeats
+            return map_parser(prefix_parser("IX") >> rule_parser(roman_numeral_5), [](int64_t a) { return a + 9; })
+                 | rule_parser(roman_numeral_5);
         }
 
-        Parser<int64_t> roman_numeral_10() { // 1-3 repeats
-            return map_parser(prefix_parser("XXX") >> roman_numeral_9(), [](int64_t a) { return a + 30; })
-                 | map_parser(prefix_parser("XX")  >> roman_numeral_9(), [](int64_t a) { return a + 20; })
-                 | map_parser(prefix_parser("X")   >> roman_numeral_9(), [](int64_t a) { return a + 10; })
-                 | roman_numeral_9();
+        inline Parser<int64_t> roman_numeral_10() { // 1-3 repeats
+            return map_parser(prefix_parser("XXX") >> rule_parser(roman_numeral_9), [](int64_t a) { return a + 30; })
+                 | map_parser(prefix_parser("XX")  >> rule_parser(roman_numeral_9), [](int64_t a) { return a + 20; })
+                 | map_parser(prefix_parser("X")   >> rule_parser(roman_numeral_9), [](int64_t a) { return a + 10; })
+                 | rule_parser(roman_numeral_9);
         }
 
-        Parser<int64_t> roman_numeral_40() { // only 1 repeats
-            return map_parser(prefix_parser("XL") >> roman_numeral_10(), [](int64_t a) { return a + 40; })
-                 | roman_numeral_10();
+        inline Parser<int64_t> roman_numeral_40() { // only 1 repeats
+            return map_parser(prefix_parser("XL") >> rule_parser(roman_numeral_10), [](int64_t a) { return a + 40; })
+                 | rule_parser(roman_numeral_10);
         }
 
-        Parser<int64_t> roman_numeral_50() { // only 1 repeats
-            return map_parser(char_parser('L') >> roman_numeral_40(), [](int64_t a) { return a + 50; })
-                 | roman_numeral_40();
+        inline Parser<int64_t> roman_numeral_50() { // only 1 repeats
+            return map_parser(char_parser('L') >> rule_parser(roman_numeral_40), [](int64_t a) { return a + 50; })
+                 | rule_parser(roman_numeral_40);
         }
 
-        Parser<int64_t> roman_numeral_90() { // only 1 repeats
-            return map_parser(prefix_parser("XC") >> roman_numeral_50(), [](int64_t a) { return a + 90; })
-                 | roman_numeral_50();
+        inline Parser<int64_t> roman_numeral_90() { // only 1 repeats
+            return map_parser(prefix_parser("XC") >> rule_parser(roman_numeral_50), [](int64_t a) { return a + 90; })
+                 | rule_parser(roman_numeral_50);
         }
 
-        Parser<int64_t> roman_numeral_100() { // 1-3 repeats
-            return map_parser(prefix_parser("CCC") >> roman_numeral_90(), [](int64_t a) { return a + 300; })
-                 | map_parser(prefix_parser("CC")  >> roman_numeral_90(), [](int64_t a) { return a + 200; })
-                 | map_parser(prefix_parser("C")   >> roman_numeral_90(), [](int64_t a) { return a + 100; })
-                 | roman_numeral_90();
+        inline Parser<int64_t> roman_numeral_100() { // 1-3 repeats
+            return map_parser(prefix_parser("CCC") >> rule_parser(roman_numeral_90), [](int64_t a) { return a + 300; })
+                 | map_parser(prefix_parser("CC")  >> rule_parser(roman_numeral_90), [](int64_t a) { return a + 200; })
+                 | map_parser(prefix_parser("C")   >> rule_parser(roman_numeral_90), [](int64_t a) { return a + 100; })
+                 | rule_parser(roman_numeral_90);
         }
 
-        Parser<int64_t> roman_numeral_400() { // only 1 repeats
-            return map_parser(prefix_parser("CD") >> roman_numeral_100(), [](int64_t a) { return a + 400; })
-                 | roman_numeral_100();
+        inline Parser<int64_t> roman_numeral_400() { // only 1 repeats
+            return map_parser(prefix_parser("CD") >> rule_parser(roman_numeral_100), [](int64_t a) { return a + 400; })
+                 | rule_parser(roman_numeral_100);
         }
 
-        Parser<int64_t> roman_numeral_500() { // only 1 repeats
-            return map_parser(char_parser('D') >> roman_numeral_400(), [](int64_t a) { return a + 500; })
-                 | roman_numeral_400();
+        inline Parser<int64_t> roman_numeral_500() { // only 1 repeats
+            return map_parser(char_parser('D') >> rule_parser(roman_numeral_400), [](int64_t a) { return a + 500; })
+                 | rule_parser(roman_numeral_400);
         }
 
-        Parser<int64_t> roman_numeral_900() { // only 1 repeats
-            return map_parser(prefix_parser("CM") >> roman_numeral_500(), [](int64_t a) { return a + 900; })  // CM
-                 | roman_numeral_500();
+        inline Parser<int64_t> roman_numeral_900() { // only 1 repeats
+            return map_parser(prefix_parser("CM") >> rule_parser(roman_numeral_500), [](int64_t a) { return a + 900; })  // CM
+                 | rule_parser(roman_numeral_500);
         }
 
-        Parser<int64_t> roman_numeral_1000() { // any number of repeats
-            Parser<int64_t> num = lazy_parser<int64_t>(roman_numeral_1000);
-            return merge_parser<std::vector<char>, int64_t, int64_t>( // Не очень простая конструкция, но зато сильно ускоряет парсинг числа
-                       many(char_parser('M')), roman_numeral_900(), // Здесь просто парсится сколько-то M-ок и остаток из других символов, потом количество M-ок умножается на 1000
-                       [](const std::vector<char>& ms, int64_t res) {
-                           return 1000 * ms.size() + res;
+        inline Parser<int64_t> roman_numeral_1000() { // any number of repeats
+            return merge_parser<std::size_t, int64_t, int64_t>( // Не очень простая конструкция, но зато сильно ускоряет парсинг числа
+                       count_many(char_parser('M')), rule_parser(roman_numeral_900), // Здесь просто парсится сколько-то M-ок и остаток из других символов, потом количество M-ок умножается на 1000
+                       [](std::size_t ms, int64_t res) {
+                           return 1000 * ms + res;
                        })
-                 | map_parser(char_parser('M') >> roman_numeral_900(), [](int64_t a) { return a + 900; })
-                 | roman_numeral_900();
+                 | map_parser(char_parser('M') >> rule_parser(roman_numeral_900), [](int64_t a) { return a + 900; })
+                 | rule_parser(roman_numeral_900);
         }
 
-        Parser<int64_t> roman_numeral() {
-            return if_equal_not_parsed<int64_t>(roman_numeral_1000(), 0) | roman_numeral_zero();
+        inline Parser<int64_t> roman_numeral() {
+            // roman_numeral_1000 consumes nothing exactly when it returns 0
+            return consumes(rule_parser(roman_numeral_1000)) | roman_numeral_zero();
         }
 
-        std::stringstream print_arabic_numeral_to_roman(int64_t x) {
+        inline std::stringstream print_arabic_numeral_to_roman(int64_t x) {
             std::stringstream ss;
             if (std::abs(x) / 1000 > 1'000'000) {
                 ss << "Result is too big for print\n";
@@ -145,3 +148,83 @@ namespace CalcParser::Internal {
         }
     }
 }
+
+namespace CalcParser::Static::RomanNumerals {
+
+    using namespace Parsec::Static;
+
+    using std::int64_t;
+
+    // constexpr twin of Internal::RomanNumerals, the 1-3 repeats are literal tries built at compile time
+
+    template<int64_t N>
+    constexpr auto add = [](int64_t a) { return a + N; };
+
+    inline constexpr auto roman_ones     = literals_parser<int64_t, 4>({{"III", 3},   {"II", 2},   {"I", 1}});
+    inline constexpr auto roman_tens     = literals_parser<int64_t, 4>({{"XXX", 30},  {"XX", 20},  {"X", 10}});
+    inline constexpr auto roman_hundreds = literals_parser<int64_t, 4>({{"CCC", 300}, {"CC", 200}, {"C", 100}});
+
+    constexpr auto roman_numeral_terminal() {
+        return id_parser<int64_t>(0);
+    }
+
+    constexpr Result<int64_t> roman_numeral_1(std::string_view str) { // 1-3 repeats
+        return (roman_ones | roman_numeral_terminal()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_4(std::string_view str) { // only 1 repeats
+        return (map_parser(prefix_parser("IV") >> rule<roman_numeral_1>(), add<4>) | rule<roman_numeral_1>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_5(std::string_view str) { // only 1 repeats
+        return (map_parser(char_parser('V') >> rule<roman_numeral_4>(), add<5>) | rule<roman_numeral_4>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_9(std::string_view str) { // only 1 repeats
+        return (map_parser(prefix_parser("IX") >> rule<roman_numeral_5>(), add<9>) | rule<roman_numeral_5>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_10(std::string_view str) { // 1-3 repeats
+        return merge_parser(roman_tens | roman_numeral_terminal(), rule<roman_numeral_9>(), std::plus<>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_40(std::string_view str) { // only 1 repeats
+        return (map_parser(prefix_parser("XL") >> rule<roman_numeral_10>(), add<40>) | rule<roman_numeral_10>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_50(std::string_view str) { // only 1 repeats
+        return (map_parser(char_parser('L') >> rule<roman_numeral_40>(), add<50>) | rule<roman_numeral_40>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_90(std::string_view str) { // only 1 repeats
+        return (map_parser(prefix_parser("XC") >> rule<roman_numeral_50>(), add<90>) | rule<roman_numeral_50>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_100(std::string_view str) { // 1-3 repeats
+        return merge_parser(roman_hundreds | roman_numeral_terminal(), rule<roman_numeral_90>(), std::plus<>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_400(std::string_view str) { // only 1 repeats
+        return (map_parser(prefix_parser("CD") >> rule<roman_numeral_100>(), add<400>) | rule<roman_numeral_100>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_500(std::string_view str) { // only 1 repeats
+        return (map_parser(char_parser('D') >> rule<roman_numeral_400>(), add<500>) | rule<roman_numeral_400>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_900(std::string_view str) { // only 1 repeats
+        return (map_parser(prefix_parser("CM") >> rule<roman_numeral_500>(), add<900>) | rule<roman_numeral_500>()).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral_1000(std::string_view str) { // any number of repeats
+        return merge_parser(count_many(char_parser('M')), rule<roman_numeral_900>(), [](std::size_t ms, int64_t res) {
+            return static_cast<int64_t>(1000 * ms + res);
+        }).parse(str);
+    }
+
+    constexpr Result<int64_t> roman_numeral(std::string_view str) {
+        return (if_equal_not_parsed(rule<roman_numeral_1000>(), int64_t(0))
+              | map_parser(char_parser('Z'), [](char) { return int64_t(0); })).parse(str);
+    }
+
+}
@@ -1,8 +1,21 @@
 #include <random>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <fstream>
 
 #include "../CalcParser.hpp"
+#include "../CalcLine.hpp"
+#include "../CalcParallel.hpp"
+#include "../CalcStack.hpp"
+#include "../CalcServer.hpp"
 #include "Test.hpp"
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sys/resource.h>
+#endif
+
 TEST(SIMPLE_NUMERALS_TEST) {
     auto parser = CalcParser::Internal::roman_numeral();
 
@@ -27,6 +40,77 @@ TEST(FUZZING_NUMERALS) {
     }
 }
 
+TEST(COMPILE_TIME_PARSING) {
+    using namespace Parsec::Static;
+
+    constexpr CharClass roman_letters("MDCLXVIZ");
+    static_assert(roman_letters.contains('X') && !roman_letters.contains('x'));
+    static_assert(token('I').parse("I  +").rest == "+");
+    static_assert(literals_parser<int, 8>({{"do", 1}, {"done", 2}, {"d", 3}}).parse("doner").value == 2);
+
+    static_assert(CalcParser::Static::RomanNumerals::roman_numeral("MCMXCIV").value == 1994);
+    static_assert(CalcParser::roman_calc_value("(MMMCCCXX + I) * MMMMMMMMMCXXIII / (II*IV + (-(-I)))") == 3366387);
+    static_assert(CalcParser::roman_calc_value(" -V / II ") == -3);
+    static_assert(!CalcParser::Static::roman_calc("I+(I").rest.empty());
+
+    // the same functions run at runtime and agree with the dynamic parser
+    const int BOUND = 1e5, ITERS = 100;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<> distr(0, BOUND);
+    auto parser = CalcParser::Internal::roman_numeral();
+    for (int it = 0; it < ITERS; ++it) {
+        std::string roman = CalcParser::arabic_numeral_to_roman(distr(gen)).str() + "IIII";
+        auto dynamic_result = parser.parse(roman);
+        auto static_result = CalcParser::Static::RomanNumerals::roman_numeral(roman);
+        ASSERT(static_result && static_result.value == dynamic_result.value());
+        ASSERT(static_result.rest == dynamic_result.rest());
+    }
+}
+
+TEST(NON_ALLOCATING_REPETITIONS) {
+    using namespace Parsec;
+
+    auto count = count_many(char_parser('M')).parse("MMMCM");
+    ASSERT(count && count.value() == 3 && count.rest() == "CM");
+
+    auto skip = skip_many(alpha()).parse("abc12");
+    ASSERT(skip && skip.rest() == "12");
+
+    auto digits = fold_many(maybe_num(), int64_t(0), [](int64_t acc, char c) { return acc * 10 + (c - '0'); });
+    auto number = digits.parse("1234x");
+    ASSERT(number && number.value() == 1234 && number.rest() == "x");
+
+    auto word = capture(alpha() >> skip_many(alpha_num())).parse("a1b2 c");
+    ASSERT(word && word.value() == "a1b2" && word.rest() == " c");
+
+    ASSERT(!capture(alpha()).parse("1"));
+}
+
+TEST(TRY_AND_CUT) {
+    using namespace Parsec;
+
+    auto ab = char_parser('a') >> char_parser('b');
+    auto ac = char_parser('a') >> char_parser('c');
+
+    auto committed = (ab | ac).parse("ac");
+    ASSERT(!committed && committed.consumed());
+
+    auto backtracked = (try_(ab) | ac).parse("ac");
+    ASSERT(backtracked && backtracked.value() == 'c');
+
+    auto not_consumed = (char_parser('x') | char_parser('y')).parse("y");
+    ASSERT(not_consumed && not_consumed.value() == 'y');
+
+    auto cutted = (cut(char_parser('x')) | char_parser('y')).parse("y");
+    ASSERT(!cutted && cutted.consumed());
+
+    auto many_committed = many(ab).parse("ababac");
+    ASSERT(!many_committed);
+
+    auto many_backtracked = many(try_(ab)).parse("ababac");
+    ASSERT(many_backtracked && many_backtracked.value().size() == 2 && many_backtracked.rest() == "ac");
+}
+
 TEST(SIMPLE_EXPR) {
     auto parser = CalcParser::Internal::roman_expr();
 
@@ -45,7 +129,7 @@ TEST(CHECK_OVERFLOW) {
 
     bool overflow_error = false;
     try {
-        auto result = parser.parse(expr);
+        parser.parse(expr);
     } catch (const std::overflow_error&) {
         overflow_error = true;
     }
@@ -76,13 +160,790 @@ TEST(DIV_BY_ZERO) {
 
     bool overflow_error = false;
     try {
-        auto res = parser.parse("I/Z");
+        parser.parse("I/Z");
     } catch (const std::overflow_error&) {
         overflow_error = true;
     }
     ASSERT(overflow_error);
 }
 
+TEST(SPACES_BETWEEN_TOKENS) {
+    auto parser = CalcParser::roman_calc();
+
+    auto result = parser.parse("  ( MMMCCCXX +\tI ) * MMMMMMMMMCXXIII / ( II*IV + ( - ( -I ) ) )  ");
+    ASSERT(result && result.rest().empty() && result.value() == 3366387);
+
+    result = parser.parse(" I +  ( I");
+    ASSERT(!result && result.consumed());
+
+    result = parser.parse(" I  ) ");
+    ASSERT(result && result.value() == 1 && result.rest() == ") ");
+
+    result = parser.parse("M CM");
+    ASSERT(result && result.value() == 1000 && result.rest() == "CM");
+}
+
+TEST(TOKENS_MATCH_CHARS) {
+    const int ITERS = 3000;
+    std::mt19937 gen(42);
+    const std::string alphabet = "MDCLXVIZ+-*/()  ?";
+    std::uniform_int_distribution<> len_distr(0, 24), char_distr(0, alphabet.size() - 1);
+
+    auto chars = CalcParser::roman_calc();
+    auto tokens = CalcParser::roman_calc_tokens();
+    for (int it = 0; it < ITERS; ++it) {
+        std::string line;
+        for (int len = len_distr(gen); len > 0; --len) {
+            line.push_back(alphabet[char_distr(gen)]);
+        }
+        if (line.find('*') != std::string::npos || line.find('/') != std::string::npos) {
+            continue; // overflow exceptions are checked elsewhere
+        }
+        auto lexed = CalcParser::tokenize(line);
+        auto char_result = chars.parse(line);
+        auto token_result = tokens.parse(lexed);
+        ASSERT(bool(char_result) == bool(token_result));
+        if (char_result) {
+            ASSERT(char_result.value() == token_result.value());
+            ASSERT(line.size() - char_result.rest().size() == CalcParser::token_position(line, token_result.rest()));
+        }
+    }
+}
+
+TEST(OTHER_INPUT_TYPES) {
+    using namespace Parsec;
+
+    auto u32 = spaces<std::u32string_view>() >> prefix_parser(std::u32string_view(U"λx"));
+    auto u32_result = u32.parse(U"  λx.x");
+    ASSERT(u32_result && u32_result.rest() == U".x");
+
+    auto u8 = lexeme(elem_parser<std::u8string_view>(u8'a'));
+    auto u8_result = u8.parse(u8"a  b");
+    ASSERT(u8_result && u8_result.rest() == u8"b");
+
+    using Bytes = std::span<const std::uint8_t>;
+    const std::uint8_t buffer[] = {0xFF, 0xFF, 0x01, 0x02};
+    auto bytes = many(elem_parser<Bytes>(0xFF)) >> elems_alt_parser<Bytes>({0x01, 0x03});
+    auto bytes_result = bytes.parse(Bytes(buffer));
+    ASSERT(bytes_result && bytes_result.value() == 0x01 && bytes_result.rest().size() == 1);
+}
+
+TEST(TOKENIZE_LONG_LINE) {
+    std::string line = "   MMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMMCMXCIX   +\t(XLII)   ";
+    auto tokens = CalcParser::tokenize(line);
+    ASSERT(tokens.size() == 5);
+    ASSERT(tokens[0].kind == CalcParser::TokenKind::Numeral && tokens[0].value == 36999 && tokens[0].offset == 3);
+    ASSERT(tokens[1].kind == CalcParser::TokenKind::Plus && tokens[1].offset == 48);
+    ASSERT(tokens[3].value == 42);
+
+    auto result = CalcParser::roman_calc_tokens().parse(tokens);
+    ASSERT(result && result.rest().empty() && result.value() == 37041);
+}
+
+std::string random_term(std::mt19937& gen, int depth) {
+    static const std::vector<std::string> numerals = {"I", "V", "X", "XLII", "MCM", "Z", "CD"};
+    std::uniform_int_distribution<> kind(0, depth > 0 ? 4 : 1), numeral(0, numerals.size() - 1);
+    switch (kind(gen)) {
+        case 0: case 1: return numerals[numeral(gen)];
+        case 2: return "-" + random_term(gen, depth - 1);
+        case 3: return "(" + random_term(gen, depth - 1) + " - " + random_term(gen, depth - 1) + ")";
+        default: return "(" + random_term(gen, depth - 1) + "*II)/ (" + random_term(gen, depth - 1) + "+M )";
+    }
+}
+
+TEST(PARALLEL_MATCHES_SEQUENTIAL) {
+    std::mt19937 gen(3);
+    std::uniform_int_distribution<> op(0, 1);
+    std::string expr = random_term(gen, 4);
+    while (expr.size() < 40'000) {
+        expr += op(gen) ? " + " : "-";
+        expr += random_term(gen, 4);
+    }
+
+    const Parsec::Grammar<int64_t> sequential(CalcParser::roman_calc);
+    const CalcParser::ParallelCalc parallel(4, 1024);
+    auto outcome = [](const auto& parser, std::string_view line) {
+        try {
+            auto result = parser.parse(line);
+            return std::tuple(bool(result), result ? result.value() : 0, result ? result.rest().size() : 0, false);
+        } catch (const std::overflow_error&) {
+            return std::tuple(false, int64_t(0), std::size_t(0), true);
+        }
+    };
+
+    std::vector<std::string> lines = {
+            expr,
+            "  " + expr + "  ",
+            expr + ")",
+            "(" + expr,
+            expr + "+",
+            expr.substr(0, expr.size() / 2) + "?" + expr.substr(expr.size() / 2),
+            expr + "+MMMMMMMMMMMMMMMMMMMMMMM*MMMMMMMMMMMMMMMMMMMMMMMMMM*MMMMMMMMMMMMMMMM*MMMMMMMMMMMMMMMMMMMMMM",
+            expr + "+I/Z-" + expr,
+    };
+    for (const auto& line : lines) {
+        ASSERT(outcome(sequential, line) == outcome(parallel, line));
+    }
+    ASSERT(std::get<0>(outcome(parallel, expr)));
+}
+
+TEST(GRAMMAR_IS_FINITE) {
+    Parsec::Grammar<int64_t> grammar(CalcParser::roman_calc);
+    std::size_t size = grammar.size();
+
+    auto result = grammar.parse("((((((((((I))))))))))+(((-(II)*III)))");
+    ASSERT(result && result.value() == -5);
+    ASSERT(grammar.size() == size);
+}
+
+TEST(HASH_CONSING) {
+    // identical subgraphs of the numeral builders are stored once: 491520 nodes before
+    Parsec::Grammar<int64_t> numeral(CalcParser::Internal::RomanNumerals::roman_numeral);
+    ASSERT(numeral.size() < 100);
+    ASSERT(numeral.parse("MCMXCIV").value() == 1994);
+    ASSERT(Parsec::Grammar<int64_t>(CalcParser::roman_calc).size() < 200);
+
+    Parsec::Internal::Arena arena;
+    Parsec::Internal::Arena::Scope scope(arena);
+    auto x = Parsec::char_parser('x');
+    ASSERT(Parsec::char_parser('x').node() == x.node() && Parsec::char_parser('y').node() != x.node());
+    auto ab = Parsec::prefix_parser("ab") >> x;
+    ASSERT((Parsec::prefix_parser(std::string_view("abc", 2)) >> x).node() == ab.node());
+    ASSERT((Parsec::prefix_parser("ab") >> Parsec::char_parser('y')).node() != ab.node());
+    ASSERT(arena.reused() == 5);
+
+    // a shared prefix node keeps its own copy of the target, not a view of the first caller's string
+    const Parsec::Internal::INode* first;
+    {
+        std::string target = "a prefix longer than the small string buffer";
+        first = Parsec::prefix_parser(target).node();
+        target.assign(target.size(), '?');
+    }
+    auto literal = Parsec::prefix_parser("a prefix longer than the small string buffer");
+    ASSERT(literal.node() == first);
+    auto matched = literal.parse("a prefix longer than the small string buffer!");
+    ASSERT(matched && matched.rest() == "!");
+
+    // lambdas capturing by copy are compared by the captured values
+    auto is = [](char c) { return [c](char e) { return e == c; }; };
+    ASSERT(Parsec::satisfy<std::string_view>(is('x')).node() == Parsec::satisfy<std::string_view>(is('x')).node());
+    ASSERT(Parsec::satisfy<std::string_view>(is('x')).node() != Parsec::satisfy<std::string_view>(is('y')).node());
+
+    // nodes with state or with lambdas capturing by reference are never shared
+    char c = 'x';
+    auto is_c = [&c](char e) { return e == c; };
+    ASSERT(Parsec::satisfy<std::string_view>(is_c).node() != Parsec::satisfy<std::string_view>(is_c).node());
+    auto adaptive = [&] { return Parsec::adaptive_alternative<char>("xy", {x, Parsec::char_parser('y')}); };
+    ASSERT(adaptive().node() != adaptive().node());
+}
+
+TEST(CONCURRENT_PARSE_STRESS) {
+    const int THREADS = 8, ITERS = 2000;
+    const Parsec::Grammar<int64_t> grammar(CalcParser::roman_calc);
+
+    std::vector<std::string> exprs = {
+            "(MMMCCCXX+I)*MMMMMMMMMCXXIII/(II*IV+(-(-I)))",
+            "V/-II",
+            "((((((I))))))*(((X)))-X",
+            "MCMXCIV-MMXX+-(CD/-VII)",
+            "I+(I",
+            "XLII*)",
+    };
+    std::vector<std::pair<bool, int64_t>> expected;
+    for (const auto& expr : exprs) {
+        auto result = grammar.parse(expr);
+        expected.emplace_back(result && result.rest().empty(), result ? result.value() : 0);
+    }
+
+    std::atomic<int> mismatches = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            for (int it = 0; it < ITERS; ++it) {
+                std::size_t i = (it + t) % exprs.size();
+                auto result = grammar.parse(exprs[i]);
+                std::pair<bool, int64_t> got(result && result.rest().empty(), result ? result.value() : 0);
+                if (got != expected[i]) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT(mismatches == 0);
+}
+
+TEST(ALLOCATION_BUDGET) {
+    const Parsec::Grammar<int64_t> numeral(CalcParser::Internal::RomanNumerals::roman_numeral);
+    const Parsec::Grammar<int64_t> calc(CalcParser::roman_calc);
+
+    // parsing allocates nothing: failed alternatives keep their messages as views
+    for (std::string_view line : {"I", "MCMXCIV", "MMMMMMMMMCMXCIX", "Z", "Q", ""}) {
+        ASSERT_ALLOCS_LE(0, numeral.parse(line));
+    }
+    for (std::string_view line : {"I", " MCMXCIV - MMXX + -(CD / -VII) ",
+                                  "(MMMCCCXX+I)*MMMMMMMMMCXXIII/(II*IV+(-(-I)))",
+                                  "((((((((((I))))))))))", "I+(I", "XLII*)", "I + Q"}) {
+        ASSERT_ALLOCS_LE(0, calc.parse(line));
+    }
+
+    // the message is built only when it is asked for
+    auto result = calc.parse("I+(I");
+    ASSERT(!result);
+    auto before = Testing::alloc_stats();
+    ASSERT(result.get_message() == "Expected ). But string is empty");
+    ASSERT(Testing::alloc_stats().bytes > before.bytes);
+}
+
+TEST(PREFILTER) {
+    const Parsec::Grammar<int64_t> calc(CalcParser::roman_calc);
+    const Parsec::Prefilter prefilter(calc.parser());
+
+    // derived from the char sets of the grammar
+    ASSERT(prefilter.alphabet() == "\t ()*+-/CDILMVXZ");
+    ASSERT(prefilter.checked_brackets() == (std::vector<std::pair<char, char>>{{'(', ')'}}));
+
+    ASSERT(!prefilter.reject(" (MCM + I) * -(X/II) "));
+    ASSERT(prefilter.reject("I+a") == 2u);
+    ASSERT(prefilter.reject("I)(") == 1u);
+    ASSERT(prefilter.reject("(I+((I)") == 0u);
+    ASSERT(prefilter.reject(std::string(100, 'I') + "$") == 100u);
+
+    // never rejects a line which is parsed completely
+    std::mt19937 gen(7);
+    const std::string chars = "IVXMZ()+-*/ i";
+    std::uniform_int_distribution<> length(0, 12), pick(0, chars.size() - 1);
+    for (int it = 0; it < 2000; ++it) {
+        std::string line;
+        for (int i = length(gen); i > 0; --i) {
+            line += chars[pick(gen)];
+        }
+        bool parsed = false;
+        try {
+            auto result = calc.parse(line);
+            parsed = result && result.rest().empty();
+        } catch (const std::overflow_error&) {
+            // thrown before the end of the line is reached
+        }
+        ASSERT(!(parsed && prefilter.reject(line)));
+    }
+
+    // the tool answers a rejected line as the parser does: where the parser stops, or with
+    // the overflow which comes before the foreign char
+    const CalcParser::LineCalc line_calc;
+    ASSERT(prefilter.reject("C-D*-/-+(") == 8u);
+    ASSERT(line_calc.evaluate("C-D*-/-+(") == "error: Parsing failed. Message: " + calc.parse("C-D*-/-+(").get_message() + '\n');
+    ASSERT(line_calc.evaluate("I + II)") == "error: Parsing failed. Part from position 7 not parsed.\n");
+    ASSERT(line_calc.evaluate("MMMMM * MMMMM * MMMMM * MMMMM * MMMMM * MMMMM $") == "error: Overflow int64 error.\n");
+
+    // unknown alphabets and brackets which are consumed elsewhere are not checked
+    ASSERT(Parsec::Prefilter(Parsec::satisfy<std::string_view>([](char c) { return c != '!'; })).alphabet().empty());
+    auto paren = Parsec::brackets_parser(Parsec::char_parser('('), Parsec::char_parser('x'), Parsec::char_parser(')'));
+    const Parsec::Prefilter loose(paren | Parsec::char_parser(')'));
+    ASSERT(loose.alphabet() == "()x");
+    ASSERT(loose.checked_brackets().empty() && !loose.reject(")"));
+}
+
+TEST(ADAPTIVE_ALTERNATIVE) {
+    const Parsec::Grammar<int64_t> calc(CalcParser::roman_calc);
+    auto profile = [](const auto& grammar) {
+        std::ostringstream out;
+        grammar.save_profile(out);
+        return out.str();
+    };
+    ASSERT(profile(calc) == "roman_atom 0 1 2\n");
+
+    // mostly bracketed traffic moves roman_brackets in front, results do not change; the
+    // branches succeed 7 : 3 : 1 times a line, so the sampled counts keep this order whatever
+    // the state of the sampler left by earlier tests
+    for (int it = 0; it < 3000; ++it) {
+        auto result = calc.parse("((I)) + -(II) * ((((V))))");
+        ASSERT(result && result.value() == -9 && result.rest().empty());
+    }
+    ASSERT(profile(calc) == "roman_atom 2 0 1\n");
+    auto failure = calc.parse("(I + ");
+    ASSERT(!failure && failure.consumed());
+    // the message of a failure is the one of the default order, whatever was learned
+    const Parsec::Grammar<int64_t> cold(CalcParser::roman_calc);
+    ASSERT(failure.get_message() == cold.parse("(I + ").get_message());
+    ASSERT(calc.parse("I + Q").get_message() == cold.parse("I + Q").get_message());
+
+    // later runs start with the learned order
+    const Parsec::Grammar<int64_t> warm(CalcParser::roman_calc);
+    std::istringstream saved(profile(calc) + "unknown 1 0\nroman_atom 0 0 1\n");
+    ASSERT(warm.load_profile(saved) == 1);
+    ASSERT(profile(warm) == "roman_atom 2 0 1\n");
+
+    // branches which may succeed on the same input keep their order
+    const Parsec::Grammar<std::string_view> overlap(+[] {
+        return Parsec::adaptive_alternative<std::string_view>("overlap", {Parsec::prefix_parser("ab"), Parsec::prefix_parser("a")}, 1);
+    });
+    for (int it = 0; it < 10; ++it) {
+        ASSERT(overlap.parse("ac").value() == "a");
+    }
+    std::istringstream reversed("overlap 1 0\n");
+    ASSERT(overlap.load_profile(reversed) == 0);
+    ASSERT(profile(overlap) == "overlap 0 1\n");
+
+    // with period 1 every success reorders the branches, which must not allocate
+    const Parsec::Grammar<char> eager(+[] {
+        return Parsec::adaptive_alternative<char>("eager", {Parsec::char_parser('x'), Parsec::char_parser('y'), Parsec::char_parser('z')}, 1);
+    });
+    for (std::string_view line : {"z", "y", "z", "x"}) {
+        ASSERT_ALLOCS_LE(0, eager.parse(line));
+    }
+}
+
+TEST(NUMERIC_LITERALS) {
+    auto integer = Parsec::integer<int64_t>();
+    auto result = integer.parse("-42x");
+    ASSERT(result && result.value() == -42 && result.rest() == "x");
+    ASSERT(integer.parse("-9223372036854775808").value() == std::numeric_limits<int64_t>::min());
+    auto overflow = integer.parse("9223372036854775808");
+    ASSERT(!overflow && overflow.consumed());
+    ASSERT(!integer.parse("-").consumed() && !integer.parse("x1"));
+
+    auto byte = Parsec::unsigned_integer<uint8_t>();
+    ASSERT(byte.parse("255").value() == 255 && !byte.parse("256") && !byte.parse("-1"));
+    ASSERT(!Parsec::unsigned_integer<int>().parse("-1"));
+
+    auto floating = Parsec::floating<double>();
+    auto number = floating.parse("-1.5e3+");
+    ASSERT(number && number.value() == -1500.0 && number.rest() == "+");
+    ASSERT(floating.parse(".25").value() == 0.25 && !floating.parse("inf") && !floating.parse("."));
+    ASSERT(!floating.parse("1e400") && floating.parse("1e400").consumed());
+
+    // arabic operands are an option of the calculator
+    const Parsec::Grammar<int64_t> mixed(CalcParser::mixed_calc);
+    auto value = mixed.parse(" XII * 3 - (IV + 10) / -II ");
+    ASSERT(value && value.value() == 43 && value.rest().empty());
+    ASSERT(mixed.parse("10 - X").value() == 0);
+    ASSERT(!mixed.parse("99999999999999999999 + I"));
+    auto roman_only = Parsec::Grammar<int64_t>(CalcParser::roman_calc).parse("10 - X");
+    ASSERT(!roman_only);
+
+    for (std::string_view line : {"12 * (4 - III)", "MCM + 100", "I + 99999999999999999999"}) {
+        ASSERT_ALLOCS_LE(0, mixed.parse(line));
+    }
+
+    std::string expr = "1";
+    for (int i = 0; i < 5000; ++i) {
+        expr += i % 2 ? " + (X * 3)" : "-4/II";
+    }
+    const CalcParser::ParallelCalc parallel(4, 1024, CalcParser::Operands::RomanAndArabic);
+    ASSERT(parallel.parse(expr).value() == mixed.parse(expr).value());
+}
+
+TEST(STACK_EVALUATION) {
+    auto outcome = [](const auto& parser, std::string_view line) {
+        try {
+            auto result = parser.parse(line);
+            return std::tuple(bool(result), result ? result.value() : 0, result ? result.rest().size() : 0,
+                              result.consumed(), result ? std::string() : result.get_message(), false);
+        } catch (const std::overflow_error&) {
+            return std::tuple(false, int64_t(0), std::size_t(0), false, std::string(), true);
+        }
+    };
+    const Parsec::Grammar<int64_t> roman(CalcParser::roman_calc);
+    const Parsec::Grammar<int64_t> mixed(CalcParser::mixed_calc);
+    const CalcParser::StackCalc roman_stack;
+    const CalcParser::StackCalc mixed_stack(std::numeric_limits<std::size_t>::max(), CalcParser::Operands::RomanAndArabic);
+
+    std::mt19937 gen(37);
+    std::string_view alphabet = "IVXLCDMZ()+-*/ 0129$";
+    std::uniform_int_distribution<std::size_t> length(0, 14), letter(0, alphabet.size() - 1);
+    for (int i = 0; i < 20'000; ++i) {
+        std::string line;
+        for (std::size_t n = length(gen); n > 0; --n) {
+            line += alphabet[letter(gen)];
+        }
+        ASSERT(outcome(roman, line) == outcome(roman_stack, line));
+        ASSERT(outcome(mixed, line) == outcome(mixed_stack, line));
+    }
+    for (int i = 0; i < 50; ++i) {
+        std::string line = random_term(gen, 4);
+        ASSERT(outcome(roman, line) == outcome(roman_stack, line));
+    }
+
+    const Parsec::Grammar<int64_t> term(CalcParser::Internal::roman_mlt_div);
+    for (std::string_view line : {"II * (III + I) - I", " I", "X/II*III", "I*", "(I"}) {
+        auto expected = term.parse(line);
+        auto actual = roman_stack.parse_term(line);
+        ASSERT(bool(expected) == bool(actual) && expected.consumed() == actual.consumed());
+        ASSERT(!expected || (expected.value() == actual.value() && expected.rest() == actual.rest()));
+    }
+
+    // nesting is limited by memory, not by the thread stack
+    const std::size_t depth = 1'000'000;
+    std::string deep = std::string(depth, '(') + std::string(depth, '-') + "II" + std::string(depth, ')') + "*III";
+    ASSERT(roman_stack.parse(deep).value() == 6);
+    ASSERT(CalcParser::ParallelCalc(4, 1024).parse(deep).value() == 6);
+    ASSERT_ALLOCS_LE(0, roman_stack.parse("((((I)))) - (-(III) * II)"));
+
+    const CalcParser::StackCalc limited(3);
+    ASSERT(limited.parse("(((I)))").value() == 1);
+    auto too_deep = limited.parse("I + ((((I))))");
+    ASSERT(!too_deep && too_deep.consumed());
+    ASSERT(too_deep.get_message() == "Brackets are nested deeper than the limit");
+    ASSERT(!CalcParser::ParallelCalc(1, 1024, CalcParser::Operands::Roman, 3).parse("((((I))))"));
+}
+
+TEST(PARSE_BUDGET) {
+    const Parsec::Grammar<int64_t> calc(CalcParser::roman_calc);
+    std::string line = "(I + II) * III";
+    for (int i = 0; i < 200; ++i) {
+        line += " - (I + II) * III";
+    }
+
+    Parsec::Budget unlimited;
+    ASSERT(calc.parse(line, unlimited).value() == -1791);
+    const std::uint64_t steps = unlimited.steps();
+    ASSERT(steps > 200);
+
+    Parsec::Budget exact(steps);
+    ASSERT(calc.parse(line, exact).value() == -1791 && exact.steps() == steps);
+    Parsec::Budget short_of_one(steps - 1);
+    bool aborted = false;
+    try {
+        calc.parse(line, short_of_one);
+    } catch (const Parsec::BudgetExceeded& e) {
+        aborted = std::string_view(e.what()) == "Step budget exceeded";
+    }
+    ASSERT(aborted);
+    // the budget is removed when the parse unwinds
+    ASSERT(Parsec::Internal::active_budget() == nullptr && calc.parse(line).value() == -1791);
+
+    Parsec::Budget expired(std::numeric_limits<std::uint64_t>::max(), Parsec::Budget::Clock::now());
+    aborted = false;
+    try {
+        calc.parse("I", expired);
+    } catch (const Parsec::BudgetExceeded& e) {
+        aborted = std::string_view(e.what()) == "Deadline exceeded";
+    }
+    ASSERT(aborted);
+
+    // long lines go through StackCalc and the workers, which charge the budget too
+    std::string long_line = line;
+    while (long_line.size() < 8000) {
+        long_line += " + " + line;
+    }
+    const CalcParser::ParallelCalc parallel(4, 4096);
+    Parsec::Budget enough;
+    ASSERT(parallel.parse(long_line, enough).value() == calc.parse(long_line).value());
+    Parsec::Budget tiny(10);
+    aborted = false;
+    try {
+        parallel.parse(long_line, tiny);
+    } catch (const Parsec::BudgetExceeded&) {
+        aborted = true;
+    }
+    ASSERT(aborted);
+    ASSERT_ALLOCS_LE(0, calc.parse(line));
+    ASSERT_ALLOCS_LE(0, calc.parse(line, unlimited));
+}
+
+TEST(DISCARD) {
+    using namespace Parsec;
+
+    {
+        Internal::Arena arena;
+        Internal::Arena::Scope scope(arena);
+        // neither the vectors of many and seq nor the values of the brackets are built
+        auto list = brackets_parser(char_parser('['), seq(many(alpha()), char_parser(',')), char_parser(']'));
+        auto list_recogniser = discard(list);
+        auto recognised = list_recogniser.parse("[ab,c,,d]x");
+        ASSERT(recognised && recognised.rest() == "x");
+        ASSERT_ALLOCS_LE(0, list_recogniser.parse("[abcdefghijklmnopqrstuvwxyz,abcdefghijklmnopqrstuvwxyz]"));
+        auto unclosed = list_recogniser.parse("[ab,c");
+        ASSERT(!unclosed && unclosed.consumed() && unclosed.get_message() == list.parse("[ab,c").get_message());
+        ASSERT(!list_recogniser.parse("x").consumed());
+
+        // out of discard the values which are dropped are still built, so their functions throw
+        auto overflow = map_parser(char_parser('x'), [](char) -> char { throw std::overflow_error("x"); });
+        auto throws = [](auto parser, std::string_view line) {
+            try {
+                parser.parse(line);
+            } catch (const std::overflow_error&) {
+                return true;
+            }
+            return false;
+        };
+        ASSERT(throws(overflow >> char_parser('y'), "xy"));
+        ASSERT(throws(brackets_parser(overflow, alpha(), char_parser(')')), "xa)"));
+        ASSERT(throws(seq(alpha(), overflow), "axb"));
+        ASSERT(throws(skip_many(overflow), "xx") && throws(count_many(overflow), "x") && throws(capture(overflow), "x"));
+        ASSERT(!throws(discard(overflow >> char_parser('y')), "xy"));
+    }
+
+    // the recogniser accepts and rejects exactly what the calculator does
+    const Grammar<int64_t> calc(CalcParser::roman_calc);
+    const Grammar<std::monostate> recogniser(+[] { return discard(CalcParser::roman_calc()); });
+    const std::string_view chars = " ()+-*/IVXLCDMZ";
+    std::mt19937 gen(41);
+    std::uniform_int_distribution<> length(0, 24), pick(0, static_cast<int>(chars.size()) - 1);
+    for (int it = 0; it < 5000; ++it) {
+        std::string line;
+        for (int i = length(gen); i > 0; --i) {
+            line += chars[pick(gen)];
+        }
+        auto skipped = recogniser.parse(line);
+        try {
+            auto parsed = calc.parse(line);
+            ASSERT(static_cast<bool>(parsed) == static_cast<bool>(skipped));
+            if (parsed) {
+                ASSERT(parsed.rest() == skipped.rest());
+            } else {
+                ASSERT(parsed.consumed() == skipped.consumed() && parsed.get_message() == skipped.get_message());
+            }
+        } catch (const std::exception&) {
+            // division by zero and overflow are errors of the values, the recogniser never sees them
+        }
+    }
+
+    std::string expr = "M";
+    for (int i = 0; i < 1000; ++i) {
+        expr += i % 2 ? " * (M - -(I))" : "/ II";
+    }
+    ASSERT_ALLOCS_LE(0, recogniser.parse(expr));
+    ASSERT(recogniser.parse(expr).rest().empty());
+}
+
+#if defined(__linux__)
+TEST(REDUCED_STACK) {
+    // lines are routed by how deep they nest, not by length, so a thread with an eighth of
+    // the usual stack evaluates short but deep lines too
+    const CalcParser::ParallelCalc calc(1);
+    std::string brackets = std::string(2047, '(') + "I" + std::string(2047, ')');
+    std::string minuses = std::string(3000, '-') + "II";
+    std::string negated;
+    for (int i = 0; i < 1000; ++i) {
+        negated += "-(";
+    }
+    negated += "III" + std::string(1000, ')');
+    std::string shallow = std::string(100, '(') + "IV" + std::string(100, ')') + " - " + minuses;
+    std::vector<std::string> lines = {brackets, minuses, negated, shallow, brackets + ")", brackets.substr(1)};
+    std::vector<std::string> outcomes;
+    auto evaluate = [&] {
+        for (const auto& line : lines) {
+            auto result = calc.parse(line);
+            outcomes.push_back(result ? std::to_string(result.value()) + "|" + std::string(result.rest())
+                                      : result.get_message());
+        }
+    };
+    auto run = [](void* body) -> void* {
+        (*static_cast<decltype(evaluate)*>(body))();
+        return nullptr;
+    };
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 1 << 20);
+    pthread_t thread;
+    ASSERT(pthread_create(&thread, &attr, run, &evaluate) == 0);
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+
+    const CalcParser::StackCalc stack;
+    ASSERT(outcomes.size() == lines.size());
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        auto expected = stack.parse(lines[i]);
+        ASSERT(outcomes[i] == (expected ? std::to_string(expected.value()) + "|" + std::string(expected.rest())
+                                        : expected.get_message()));
+    }
+    ASSERT(outcomes[0] == "1|" && outcomes[1] == "2|" && outcomes[2] == "3|" && outcomes[3] == "2|");
+}
+
+TEST(SOCKET_SERVER) {
+    const CalcParser::LineCalc calc;
+    const std::string path = "/tmp/calc_parser_test_" + std::to_string(::getpid()) + ".sock";
+    CalcParser::Server server(calc, path, 3);
+    std::thread loop([&] { server.run(); });
+
+    std::mt19937 gen(40);
+    std::vector<std::string> lines = {"I + I", "XX *", "MMMMMMMMMMMMMMMMMMMMMMM*MMMMMMMMMMMMMMMMMMMMM*MMMMMMMMMMMMMMMMMMMMMMMM", "I/Z", "", "$"};
+    while (lines.size() < 1000) {
+        lines.push_back(random_term(gen, 3));
+    }
+    std::string data;
+    for (const auto& line : lines) {
+        data += line + '\n';
+    }
+    data += "(I"; // the last line may end without '\n'
+    lines.push_back("(I");
+
+    // lines are cut at arbitrary points and pipelined, answers come in the order of the lines
+    auto check = [&](unsigned seed) {
+        CalcParser::Client client(path);
+        std::mt19937 cuts(seed);
+        std::uniform_int_distribution<std::size_t> cut(1, 3000);
+        for (std::size_t pos = 0; pos < data.size();) {
+            std::size_t size = cut(cuts);
+            client.send(std::string_view(data).substr(pos, size));
+            pos += size;
+        }
+        client.finish();
+        bool same = true;
+        for (const auto& line : lines) {
+            auto answer = client.receive();
+            same = same && answer && *answer + '\n' == calc.evaluate(line);
+        }
+        return same && !client.receive();
+    };
+    std::vector<std::future<bool>> clients;
+    for (unsigned i = 0; i < 4; ++i) {
+        clients.push_back(std::async(std::launch::async, check, i));
+    }
+    bool same = true;
+    for (auto& client : clients) {
+        same = client.get() && same;
+    }
+    server.stop();
+    loop.join();
+    ASSERT(same);
+
+    // a socket left behind by a server is replaced, any other file at the path is kept
+    const std::string taken = path + ".txt";
+    std::ofstream(taken) << "kept";
+    bool refused = false;
+    try {
+        CalcParser::Server other(calc, taken, 1);
+    } catch (const std::system_error& error) {
+        refused = error.code() == std::errc::address_in_use;
+    }
+    std::string content;
+    std::ifstream(taken) >> content;
+    ASSERT(refused && content == "kept");
+    ::unlink(taken.c_str());
+    {
+        CalcParser::Internal::Serve::Fd stale(::socket(AF_UNIX, SOCK_STREAM, 0));
+        sockaddr_un addr = CalcParser::Internal::Serve::address(taken);
+        ASSERT(::bind(stale.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    }
+    {
+        CalcParser::Server other(calc, taken, 1);
+    }
+    struct stat removed{};
+    ASSERT(::lstat(taken.c_str(), &removed) < 0);
+}
+
+TEST(SOCKET_SERVER_LIMITS) {
+    const CalcParser::LineCalc calc;
+    const std::string path = "/tmp/calc_parser_limits_" + std::to_string(::getpid()) + ".sock";
+    auto thread_cpu = [] {
+        timespec time{};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+    };
+
+    // a client which does not read its answers is stopped by its socket: the server does not
+    // read what does not fit into the socket buffers and max_pending
+    bool throttled, answered = true;
+    {
+        CalcParser::Server server(calc, path, 1, 4096);
+        std::thread loop([&] { server.run(); });
+        const std::string line(1000, '$');
+        const std::size_t count = 16000;
+        CalcParser::Client client(path);
+        std::atomic<std::size_t> sent = 0;
+        std::thread sender([&] {
+            std::string data;
+            for (std::size_t i = 0; i < count; ++i) {
+                data += line + '\n';
+            }
+            for (std::size_t pos = 0; pos < data.size(); pos += 1 << 16) {
+                client.send(std::string_view(data).substr(pos, 1 << 16));
+                sent += 1 << 16;
+            }
+            client.finish();
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        throttled = sent < count * (line.size() + 1);
+        const std::string expected = calc.evaluate(line);
+        for (std::size_t i = 0; i < count; ++i) {
+            auto answer = client.receive();
+            answered = answered && answer && *answer + '\n' == expected;
+        }
+        answered = answered && !client.receive();
+        sender.join();
+        server.stop();
+        loop.join();
+    }
+    ASSERT(throttled && answered);
+
+    // a client which hangs up while its batches are evaluated does not keep the loop busy
+    std::chrono::nanoseconds loop_cpu{};
+    std::chrono::steady_clock::duration wall{};
+    bool served;
+    {
+        CalcParser::Server server(calc, path, 1);
+        std::thread loop([&] {
+            server.run();
+            loop_cpu = thread_cpu();
+        });
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::string expr = "I";
+            for (int i = 0; i < 20000; ++i) {
+                expr += " + (II * III)";
+            }
+            CalcParser::Client gone(path);
+            gone.send(expr + '\n' + expr + '\n' + expr + '\n');
+        }
+        // one worker: the answer comes after the batches of the client which is gone
+        CalcParser::Client client(path);
+        client.send("II\n");
+        client.finish();
+        auto answer = client.receive();
+        served = answer && *answer == "II";
+        wall = std::chrono::steady_clock::now() - start;
+        server.stop();
+        loop.join();
+    }
+    ASSERT(served);
+    ASSERT(loop_cpu * 10 < wall);
+
+    // a client which can not be accepted for lack of descriptors does not keep the loop busy
+    // either, and is served once descriptors are free again
+    std::string answer;
+    {
+        CalcParser::Server server(calc, path, 1);
+        std::thread loop([&] {
+            server.run();
+            loop_cpu = thread_cpu();
+        });
+        auto start = std::chrono::steady_clock::now();
+        CalcParser::Internal::Serve::Fd waiting(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        rlimit limit{};
+        ::getrlimit(RLIMIT_NOFILE, &limit);
+        rlimit lowered = limit;
+        lowered.rlim_cur = static_cast<rlim_t>(waiting.get()) + 1;
+        ASSERT(::setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+        std::vector<CalcParser::Internal::Serve::Fd> fillers;
+        for (int fd; (fd = ::dup(waiting.get())) >= 0;) {
+            fillers.emplace_back(fd);
+        }
+        sockaddr_un addr = CalcParser::Internal::Serve::address(path);
+        ASSERT(::connect(waiting.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        fillers.clear();
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+
+        ASSERT(::write(waiting.get(), "III\n", 4) == 4);
+        ::shutdown(waiting.get(), SHUT_WR);
+        char buffer[64];
+        for (ssize_t size; (size = ::read(waiting.get(), buffer, sizeof(buffer))) > 0;) {
+            answer.append(buffer, static_cast<std::size_t>(size));
+        }
+        wall = std::chrono::steady_clock::now() - start;
+        server.stop();
+        loop.join();
+    }
+    ASSERT(answer == calc.evaluate("III"));
+    ASSERT(loop_cpu * 10 < wall);
+}
+#endif
+
 int main() {
     RUN_ALL_TESTS;
 }
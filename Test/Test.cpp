@@ -1,4 +1,5 @@
 #include <iostream>
+#include <new>
 
 #include "Test.hpp"
 
@@ -11,4 +12,40 @@ bool ::Testing::Testable::check(bool condition, std::string fileName,
         failed = true;
     }
     return condition;
-}
\ No newline at end of file
+}
+
+// allocations are counted per thread, so a test is not affected by workers of other tests
+static thread_local ::Testing::AllocStats allocStats;
+
+::Testing::AllocStats Testing::alloc_stats() {
+    return allocStats;
+}
+
+void* operator new(std::size_t size) {
+    ++allocStats.count;
+    allocStats.bytes += size;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
@@ -7,6 +7,14 @@
 
 namespace Testing {
 
+    // heap allocations made by the current thread through operator new
+    struct AllocStats {
+        std::size_t count = 0;
+        std::size_t bytes = 0;
+    };
+
+    AllocStats alloc_stats();
+
     class Testable;
 
     static inline std::vector<Testable*> testCases;
@@ -45,6 +53,15 @@ void TestCase::Test()
 
 #define ASSERT(x) if (!Testing::Testable::check(x, __FILE__, #x, __FUNCTION__, __LINE__)) return;
 
+// fails if the statement allocates more than n times
+#define ASSERT_ALLOCS_LE(n, statement) \
+{ \
+  const std::size_t allocsBefore = ::Testing::alloc_stats().count; \
+  statement; \
+  const std::size_t allocs = ::Testing::alloc_stats().count - allocsBefore; \
+  ASSERT(allocs <= (n)); \
+}
+
 #define RUN_ALL_TESTS \
 { \
   int failed = 0; \
@@ -0,0 +1,180 @@
+#include "CalcLine.hpp"
+#include "CalcServer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Load generator for VKCoreTest --serve=PATH: every connection sends its lines in batches and
+// keeps up to --window batches in flight, then the throughput and the batch latencies are printed.
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    int usage(const char* program, std::string_view error) {
+        std::cerr << program << ": " << error << "\n"
+                  << "usage: " << program << " --socket=PATH [--input=FILE] [--connections=N] [--lines=N]"
+                  << " [--batch=N] [--window=N]\n";
+        return 2;
+    }
+
+    struct Options {
+        std::string socket;
+        std::string input;             // lines to send, random expressions if empty
+        unsigned connections = 4;
+        std::size_t lines = 100'000;   // per connection
+        std::size_t batch = 100;       // lines per write
+        std::size_t window = 8;        // batches in flight per connection
+    };
+
+    std::vector<std::string> random_lines(std::size_t count, unsigned seed) {
+        static const char* numerals[] = {"I", "IV", "IX", "XII", "XL", "XC", "CD", "MCM", "MMXXIV", "Z"};
+        static const char* operators[] = {" + ", " - ", " * ", " / "};
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<> numeral(0, std::size(numerals) - 2), op(0, 3), terms(1, 6);
+        std::vector<std::string> lines;
+        for (std::size_t i = 0; i < count; ++i) {
+            std::string line = numerals[numeral(gen)];
+            for (int t = terms(gen); t > 1; --t) {
+                line += operators[op(gen)];
+                line += t % 3 == 0 ? std::string("(") + numerals[numeral(gen)] + " - I)" : numerals[numeral(gen)];
+            }
+            lines.push_back(std::move(line));
+        }
+        return lines;
+    }
+
+    struct Report {
+        std::size_t answers = 0;
+        std::vector<double> latencies; // per batch, ms
+    };
+
+    Report run_connection(const Options& options, const std::vector<std::string>& lines) {
+        CalcParser::Client client(options.socket);
+        Report report;
+        std::vector<Clock::time_point> sent;
+        std::size_t next = 0;
+        auto send_batch = [&] {
+            std::string data;
+            for (std::size_t end = std::min(next + options.batch, lines.size()); next < end; ++next) {
+                data += lines[next];
+                data += '\n';
+            }
+            sent.push_back(Clock::now());
+            client.send(data);
+        };
+        while (next < lines.size() && sent.size() < options.window) {
+            send_batch();
+        }
+        if (next == lines.size()) {
+            client.finish();
+        }
+        while (auto answer = client.receive()) {
+            ++report.answers;
+            if (report.answers % options.batch == 0 || report.answers == lines.size()) {
+                std::size_t batch = (report.answers - 1) / options.batch;
+                report.latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent[batch]).count());
+                if (next < lines.size()) {
+                    send_batch();
+                    if (next == lines.size()) {
+                        client.finish();
+                    }
+                }
+            }
+        }
+        return report;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        std::string value(arg.substr(arg.find('=') + 1));
+        auto bad_value = [&] { return usage(argv[0], "bad value of " + std::string(arg)); };
+        if (arg.starts_with("--socket=")) {
+            options.socket = value;
+        } else if (arg.starts_with("--input=")) {
+            options.input = value;
+        } else if (arg.starts_with("--connections=")) {
+            auto connections = CalcParser::option_number<unsigned>(value);
+            if (!connections || *connections == 0) {
+                return bad_value();
+            }
+            options.connections = *connections;
+        } else if (arg.starts_with("--lines=")) {
+            auto lines = CalcParser::option_number<std::size_t>(value);
+            if (!lines) {
+                return bad_value();
+            }
+            options.lines = *lines;
+        } else if (arg.starts_with("--batch=")) {
+            auto batch = CalcParser::option_number<std::size_t>(value);
+            if (!batch || *batch == 0) {
+                return bad_value();
+            }
+            options.batch = *batch;
+        } else if (arg.starts_with("--window=")) {
+            auto window = CalcParser::option_number<std::size_t>(value);
+            if (!window || *window == 0) {
+                return bad_value();
+            }
+            options.window = *window;
+        } else {
+            return usage(argv[0], "unknown argument " + std::string(arg));
+        }
+    }
+    if (options.socket.empty()) {
+        return usage(argv[0], "--socket is required");
+    }
+
+    std::vector<std::vector<std::string>> lines(options.connections);
+    if (!options.input.empty()) {
+        std::ifstream in(options.input);
+        std::vector<std::string> file;
+        for (std::string line; std::getline(in, line);) {
+            file.push_back(line);
+        }
+        for (auto& connection : lines) {
+            for (std::size_t i = 0; i < options.lines && !file.empty(); ++i) {
+                connection.push_back(file[i % file.size()]);
+            }
+        }
+    } else {
+        for (unsigned c = 0; c < options.connections; ++c) {
+            lines[c] = random_lines(options.lines, c);
+        }
+    }
+
+    std::vector<Report> reports(options.connections);
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < options.connections; ++c) {
+        threads.emplace_back([&, c] { reports[c] = run_connection(options, lines[c]); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::size_t expected = 0, answers = 0;
+    std::vector<double> latencies;
+    for (unsigned c = 0; c < options.connections; ++c) {
+        expected += lines[c].size();
+        answers += reports[c].answers;
+        latencies.insert(latencies.end(), reports[c].latencies.begin(), reports[c].latencies.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+    };
+    std::cout << answers << " answers to " << expected << " lines in " << seconds << " s, "
+              << static_cast<std::size_t>(answers / seconds) << " lines/s\n"
+              << "batch latency ms: p50 " << percentile(0.5) << ", p99 " << percentile(0.99)
+              << ", max " << percentile(1.0) << '\n';
+    return answers == expected ? 0 : 1;
+}
@@ -1,25 +1,128 @@
 #include "CalcParser.hpp"
+#include "CalcLine.hpp"
+#include "CalcServer.hpp"
 
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <csignal>
+#include <limits>
+#include <optional>
 
-int main() {
-    auto parser = CalcParser::roman_calc();
-
-    std::string str;
-    while (std::getline(std::cin, str)) {
-        str = CalcParser::remove_all_spaces(str);
-        try {
-            auto result = parser.parse(str);
-            if (result && result.rest().empty()) {
-                std::cout << CalcParser::arabic_numeral_to_roman(result.value()).str();
-            } else if (result) {
-                std::cout << "error: Parsing failed. Part from position " << str.size() - result.rest().size() + 1 << " not parsed." << '\n';
-            } else {
-                std::cout << "error: Parsing failed. Message: " << result.get_message() << '\n';
+namespace {
+    int usage(const char* program, std::string_view error) {
+        std::cerr << program << ": " << error << "\n"
+                  << "usage: " << program << " [--arabic] [--max-depth=N] [--max-steps=N] [--timeout-ms=N]"
+                  << " [--serve=PATH] [--workers=N] [--profile=PATH]\n";
+        return 2;
+    }
+
+#if defined(__linux__)
+    std::atomic<CalcParser::Server*> serving = nullptr;
+
+    void stop_serving(int) {
+        if (CalcParser::Server* server = serving.load()) {
+            server->stop();
+        }
+    }
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    // --arabic: arabic operands are accepted too
+    // --max-depth=N: lines with more than N nested brackets are errors, by default nesting is limited by memory
+    // --max-steps=N, --timeout-ms=N: budget of one line, lines which run out of it are reported and counted
+    // --serve=PATH: answer lines of clients of a Unix domain socket instead of stdin, until SIGINT or SIGTERM
+    //   (Linux only)
+    // --workers=N: threads evaluating the lines of the clients
+    // --profile=PATH: file with the learned order of alternatives, read at start and written at exit
+    //   (a bare PATH argument is accepted too); unknown options are errors, so a typo never becomes a file
+    CalcParser::LineOptions options;
+    const char* profile = nullptr;
+    std::optional<std::string> socket_path;
+    [[maybe_unused]] unsigned workers = std::max(std::thread::hardware_concurrency(), 1u); // of --serve
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        std::string value(arg.substr(arg.find('=') + 1));
+        auto bad_value = [&] { return usage(argv[0], "bad value of " + std::string(arg)); };
+        if (arg == "--arabic") {
+            options.operands = CalcParser::Operands::RomanAndArabic;
+        } else if (arg.starts_with("--max-depth=")) {
+            auto max_depth = CalcParser::option_number<std::size_t>(value);
+            if (!max_depth) {
+                return bad_value();
+            }
+            options.max_depth = *max_depth;
+        } else if (arg.starts_with("--max-steps=")) {
+            auto max_steps = CalcParser::option_number<std::uint64_t>(value);
+            if (!max_steps) {
+                return bad_value();
+            }
+            options.max_steps = *max_steps;
+        } else if (arg.starts_with("--timeout-ms=")) {
+            auto timeout = CalcParser::option_number<std::uint32_t>(value);
+            if (!timeout) {
+                return bad_value();
+            }
+            options.timeout = std::chrono::milliseconds(*timeout);
+        } else if (arg.starts_with("--serve=")) {
+#if defined(__linux__)
+            socket_path = value;
+#else
+            return usage(argv[0], "--serve is not supported on this platform");
+#endif
+        } else if (arg.starts_with("--workers=")) {
+            auto count = CalcParser::option_number<unsigned>(value);
+            if (!count || *count == 0) {
+                return bad_value();
             }
-        } catch (const std::overflow_error&) {
-            std::cout << "error: Overflow int64 error.\n";
+            workers = *count;
+        } else if (arg.starts_with("--profile=")) {
+            profile = argv[i] + std::string_view("--profile=").size();
+        } else if (arg.starts_with("-") || profile) {
+            return usage(argv[0], "unknown argument " + std::string(arg));
+        } else {
+            profile = argv[i];
         }
     }
-}
\ No newline at end of file
+    // the workers already keep the cores busy, so a long line is not split between them
+    if (socket_path) {
+        options.threads = 1;
+    }
+
+    // long lines are split between cores, short ones are parsed as usual
+    const CalcParser::LineCalc calc(options);
+    if (profile) {
+        std::ifstream in(profile);
+        calc.load_profile(in);
+    }
+
+#if defined(__linux__)
+    if (socket_path) {
+        CalcParser::Server server(calc, *socket_path, workers);
+        serving = &server;
+        std::signal(SIGINT, stop_serving);
+        std::signal(SIGTERM, stop_serving);
+        server.run();
+        serving = nullptr;
+    } else
+#endif
+    {
+        std::string str;
+        while (std::getline(std::cin, str)) {
+            std::cout << calc.evaluate(str);
+        }
+    }
+    if (calc.aborted() > 0) {
+        std::cerr << calc.aborted() << " line(s) aborted: parse budget exceeded\n";
+    }
+
+    if (profile) {
+        std::ofstream out(profile);
+        calc.save_profile(out);
+    }
+}